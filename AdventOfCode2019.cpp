@@ -17,13 +17,23 @@
 #include <utility>
 #include <optional>
 #include <thread>
+#include <chrono>
 #include <tuple>
 #include <mutex>
 #include <regex>
 
 #include "intcode.hpp"
+#include "intcode_batch.hpp"
+#include "intcode_constexpr.hpp"
+#include "intcode_coroutine.hpp"
+#include "intcode_network.hpp"
+#include "intcode_pipeline.hpp"
+#include "intcode_scheduler.hpp"
+#include "intcode_specializer.hpp"
+#include "intcode_verifier.hpp"
 #include "input_utilities.hpp"
 #include "search_algorithms.hpp"
+#include "tools.hpp"
 
 std::pair<int64_t, int64_t> day_1(const std::string& input_filepath)
 {
@@ -48,11 +58,7 @@ std::pair<int64_t, int64_t> day_1(const std::string& input_filepath)
 
 std::pair<int64_t, int64_t> day_2(const std::string& input_filepath)
 {
-	std::vector<int64_t> opcodes;
-
-	for (auto line : next_file_line(input_filepath))
-		for (auto opcode : next_line_token<int64_t>(line))
-			opcodes.push_back(opcode);
+	auto opcodes = load_program(input_filepath);
 
 	int64_t dummy;
 
@@ -61,16 +67,30 @@ std::pair<int64_t, int64_t> day_2(const std::string& input_filepath)
 	part1.memory[2] = 2;
 	part1.run(dummy);
 
+	// noun and verb only feed arithmetic, so the program usually specializes to a formula over them
+	auto specialized = specialize(opcodes, {}, { 1, 2 });
+	auto formula = specialized.formula(0);
+
+	IntcodeVMPool pool(opcodes);
+
+	auto output_for = [&](int64_t noun, int64_t verb)
+	{
+		if (specialized.complete)
+			return formula({ noun, verb });
+
+		auto part2 = pool.acquire();
+		part2->memory[1] = noun;
+		part2->memory[2] = verb;
+		part2->run(dummy);
+
+		return part2->memory[0];
+	};
+
 	for (int64_t i = 0; i < 100; i++)
 	{
 		for (int64_t j = 0; j < 100; j++)
 		{
-			IntcodeVM part2(opcodes);
-			part2.memory[1] = i;
-			part2.memory[2] = j;
-			part2.run(dummy);
-
-			if (part2.memory[0] == 19690720)
+			if (output_for(i, j) == 19690720)
 				return { part1.memory[0], 100 * i + j };
 		}
 	}
@@ -349,11 +369,7 @@ std::pair<int64_t, int64_t> day_4(const std::string& input_filepath)
 
 std::pair<int64_t, int64_t> day_5(const std::string& input_filepath)
 {
-	std::vector<int64_t> memory;
-
-	for (auto line : next_file_line(input_filepath))
-		for (auto word : next_line_token<int64_t>(line))
-			memory.push_back(word);
+	auto memory = load_program(input_filepath);
 
 	std::vector<int64_t> results;
 	
@@ -426,85 +442,14 @@ std::pair<int64_t, int64_t> day_6(const std::string& input_filepath)
 
 std::pair<int64_t, int64_t> day_7(const std::string& input_filepath)
 {
-	std::vector<int64_t> amplifier_program;
-
-	for (auto line : next_file_line(input_filepath))
-		for (auto word : next_line_token<int64_t>(line))
-			amplifier_program.push_back(word);
-
-	std::vector<int64_t> thruster_outputs;
-
-	std::array<int64_t, 5> phases = { 0, 1, 2, 3, 4 };
-	do
-	{
-		int64_t amplifier_output = 0;
-
-		for (size_t i = 0; i < phases.size(); i++)
-		{
-			IntcodeVM amplifier(amplifier_program);
-
-			amplifier.run(amplifier_output, phases[i]);
-			amplifier.run(amplifier_output, amplifier_output);
-			amplifier.run(amplifier_output);
-		}
-		
-		thruster_outputs.push_back(amplifier_output);
-
-	} while (std::next_permutation(phases.begin(), phases.end()));
+	constexpr size_t amplifier_count = 5;
 
-	std::vector<int64_t> feedback_outputs;
+	auto amplifier_program = load_program(input_filepath);
 
-	do
-	{
-		std::array<IntcodeVM, 5> amplifiers = {
-			IntcodeVM(amplifier_program),
-			IntcodeVM(amplifier_program),
-			IntcodeVM(amplifier_program),
-			IntcodeVM(amplifier_program),
-			IntcodeVM(amplifier_program)
-		};
-
-		int64_t amplifier_output = 0;
-		int64_t last_amplifier_output = -1;
-
-		for (size_t i = 0; i < phases.size(); i++)
-		{
-			auto &amplifier = amplifiers[i];
-			amplifier.run(amplifier_output, phases[i] + 5);
-		}
-
-		bool halted = false;
-		do
-		{
-			for (size_t i = 0; i < phases.size(); i++)
-			{
-				auto &amplifier = amplifiers[i];
-
-				if (amplifier.run(amplifier_output, amplifier_output) != execution_state_t::consumed_value)
-				{
-					halted = true;
-					break;
-				}
-
-				if (amplifier.run(amplifier_output) != execution_state_t::provided_value)
-				{
-					halted = true;
-					break;
-				}
-
-				if (i == phases.size() - 1)
-					last_amplifier_output = amplifier_output;
-			}
-		} while (!halted);
+	auto thruster = search_phases(amplifier_program, { 0, 1, 2, 3, 4 }, amplifier_count, false);
+	auto feedback = search_phases(amplifier_program, { 5, 6, 7, 8, 9 }, amplifier_count, true);
 
-		feedback_outputs.push_back(last_amplifier_output);
-
-	} while (std::next_permutation(phases.begin(), phases.end()));
-
-	return { 
-		*std::max_element(thruster_outputs.begin(), thruster_outputs.end()),
-		*std::max_element(feedback_outputs.begin(), feedback_outputs.end())
-	};
+	return { thruster.signal, feedback.signal };
 }
 std::pair<int64_t, int64_t> day_8(const std::string& input_filepath)
 {
@@ -557,11 +502,7 @@ std::pair<int64_t, int64_t> day_8(const std::string& input_filepath)
 
 std::pair<int64_t, int64_t> day_9(const std::string& input_filepath)
 {
-	std::vector<int64_t> boost;
-
-	for (auto line : next_file_line(input_filepath))
-		for (auto word : next_line_token<int64_t>(line))
-			boost.push_back(word);
+	auto boost = load_program(input_filepath);
 
 	std::vector<int64_t> results;
 
@@ -569,6 +510,7 @@ std::pair<int64_t, int64_t> day_9(const std::string& input_filepath)
 	{
 		execution_state_t state{};
 		IntcodeVM vm(boost);
+		vm.engine = engine_t::blocks;
 
 		int64_t result = 0;
 		do
@@ -753,22 +695,18 @@ struct HullPainter
 	{
 		panel_colors[{ position_x, position_y }] = initial_color ? '*' : ' ';
 
-		while (true)
+		while (state != execution_state_t::halted)
 		{
-			int64_t output = -1;
-
 			int64_t current_color = panel_colors[{ position_x, position_y }] == ' ' ? 0 : 1;
 
-			state = vm.run(output, current_color);
-			if (state == execution_state_t::halted) break;
+			// the robot answers every color with a new color and a turn, then waits for the next color
+			vm.input_channel.push(current_color);
+			state = vm.run();
 
-			state = vm.run(output, current_color);
-			if (state == execution_state_t::halted) break;
-			panel_colors[{ position_x, position_y }] = output ? '*' : ' ';
+			if (vm.output_channel.size() < 2) break;
 
-			state = vm.run(output, current_color);
-			if (state == execution_state_t::halted) break;
-			next_turn = output == 0 ? ccw : cw;
+			panel_colors[{ position_x, position_y }] = vm.output_channel.pop() ? '*' : ' ';
+			next_turn = vm.output_channel.pop() == 0 ? ccw : cw;
 
 			current_direction = (4 + current_direction + next_turn) % 4;
 
@@ -785,11 +723,7 @@ struct HullPainter
 
 std::pair<int64_t, int64_t> day_11(const std::string& input_filepath)
 {
-	std::vector<int64_t> program_words;
-
-	for (auto line : next_file_line(input_filepath))
-		for (auto word : next_line_token<int64_t>(line))
-			program_words.push_back(word);
+	auto program_words = load_program(input_filepath);
 
 	IntcodeVM part_1_vm(program_words);
 	HullPainter part_1_painter(part_1_vm);
@@ -859,67 +793,61 @@ struct ArcadeCabinet
 				moving_direction = ball_position.second < paddle_position.second ? -1 : 1;
 		};
 
+		auto& screen_updates = game.output_channel;
+
 		do
 		{
-			update_moving_direction();
-
-			int64_t x;
-			state = game.run(x, moving_direction);
-			if (state == execution_state_t::consumed_value) 
-				state = game.run(x, moving_direction);
-
-			if (state == execution_state_t::halted) break;
-
-			int64_t y;
-			state = game.run(y, moving_direction);
-			if (state == execution_state_t::consumed_value) 
-				state = game.run(y, moving_direction);
-
-			if (state == execution_state_t::halted) break;
+			state = game.run();
 
-			int64_t tile_id;
-			state = game.run(tile_id, moving_direction);
-			if (state == execution_state_t::consumed_value) 
-				state = game.run(tile_id, moving_direction);
+			while (screen_updates.size() >= 3)
+			{
+				auto x = screen_updates.pop();
+				auto y = screen_updates.pop();
+				auto tile_id = screen_updates.pop();
 
-			if (state == execution_state_t::halted) break;
+				if (x == -1)
+				{
+					score = tile_id;
+					continue;
+				}
 
-			if (x == -1)
-			{
-				score = tile_id;
-				continue;
-			}
+				point_t position = { y, x };
 
-			point_t position = { y, x };
+				switch (tile_id)
+				{
+				case empty:
+					screen[position] = ' ';
+					break;
 
-			switch (tile_id)
-			{
-			case empty:
-				screen[position] = ' ';
-				break;
+				case wall:
+					screen[position] = '#';
+					break;
 
-			case wall:
-				screen[position] = '#';
-				break;
+				case block:
+					screen[position] = '|';
+					break;
 
-			case block:
-				screen[position] = '|';
-				break;
+				case paddle:
+					screen[position] = '_';
+					paddle_position = position;	
+					render();
+					break;
 
-			case paddle:
-				screen[position] = '_';
-				paddle_position = position;	
-				render();
-				break;
+				case ball:
+					screen[position] = 'o';
+					ball_position = position;
+					render();
+					break;
 
-			case ball:
-				screen[position] = 'o';
-				ball_position = position;
-				render();
-				break;
+				default:
+					break;
+				}
+			}
 
-			default:
-				break;
+			if (state == execution_state_t::requested_value)
+			{
+				update_moving_direction();
+				game.input_channel.push(moving_direction);
 			}
 		} while (state != execution_state_t::halted);
 	}
@@ -1023,11 +951,7 @@ std::pair<int64_t, int64_t> day_12(const std::string& input_filepath)
 
 std::pair<int64_t, int64_t> day_13(const std::string& input_filepath)
 {
-	std::vector<int64_t> program_words;
-
-	for (auto line : next_file_line(input_filepath))
-		for (auto word : next_line_token<int64_t>(line))
-			program_words.push_back(word);
+	auto program_words = load_program(input_filepath);
 
 	ArcadeCabinet part1(program_words);
 	part1.play();
@@ -1277,7 +1201,7 @@ struct RepairDroid
 		world[starting] = droid;
 	}
 
-	void explore(IntcodeVM vm, position_t current, int64_t direction)
+	void explore(const IntcodeVM& parent, position_t current, int64_t direction)
 	{
 		auto moved_to = current;
 		moved_to = moved_to + direction;
@@ -1285,6 +1209,8 @@ struct RepairDroid
 		if (world[moved_to])
 			return;
 
+		auto vm = parent.fork();
+
 		int64_t output;
 		vm.run(output, direction);
 		vm.run(output, direction);
@@ -1308,7 +1234,7 @@ struct RepairDroid
 		step(vm, moved_to);
 	}
 
-	void step(IntcodeVM vm, position_t current = {})
+	void step(const IntcodeVM& vm, position_t current = {})
 	{
 		for (int64_t direction = north; direction < direction_last; direction++)
 		{
@@ -1422,11 +1348,7 @@ auto manhattan_distance(position_t p1, position_t p2) -> int64_t
 
 std::pair<int64_t, int64_t> day_15(const std::string& input_filepath)
 {
-	std::vector<int64_t> opcodes;
-
-	for (auto line : next_file_line(input_filepath))
-		for (auto opcode : next_line_token<int64_t>(line))
-			opcodes.push_back(opcode);
+	auto opcodes = load_program(input_filepath);
 
 	IntcodeVM program(opcodes);
 	RepairDroid droid;
@@ -1933,11 +1855,7 @@ std::pair<int64_t, int64_t> day_18(const std::string& input_filepath)
 
 std::pair<int64_t, int64_t> day_19(const std::string& input_filepath)
 {
-	std::vector<int64_t> opcodes;
-	
-	for (auto line : next_file_line(input_filepath))
-		for (auto opcode : next_line_token<int64_t>(line))
-			opcodes.push_back(opcode);
+	auto opcodes = load_program(input_filepath);
 
 	int64_t output;
 
@@ -1945,23 +1863,28 @@ std::pair<int64_t, int64_t> day_19(const std::string& input_filepath)
 
 	uint8_t part1 = 0;
 
+	std::vector<std::vector<int64_t>> probes;
+
 	for (int64_t y = 0; y < 50; y++)
-	{
 		for (int64_t x = 0; x < 50; x++)
-		{
-			IntcodeVM drones(opcodes);
+			probes.push_back({ x, y });
+
+	IntcodeBatch batch(opcodes);
+	auto pulled = batch.run(probes);
 
-			drones.run(output, x);
-			drones.run(output, y);
-			drones.run(output);
+	for (size_t i = 0; i < probes.size(); i++)
+	{
+		auto x = probes[i][0];
+		auto y = probes[i][1];
 
-			world[{ static_cast<int8_t>(x), static_cast<int8_t>(y) }] = output ? '#' : '.';
+		world[{ static_cast<int8_t>(x), static_cast<int8_t>(y) }] = pulled[i][0] ? '#' : '.';
 
-			if (output)
-				part1++;
-		}
+		if (pulled[i][0])
+			part1++;
 	}
 
+	IntcodeVMPool pool(opcodes);
+
 	display(world, false);
 
 	int64_t ship_size = 100;
@@ -1977,10 +1900,10 @@ std::pair<int64_t, int64_t> day_19(const std::string& input_filepath)
 		while (true)
 		{
 			// I bet they made the program non-reentrant so we couldn't brute force this
-			IntcodeVM drones(opcodes);
-			drones.run(output, x);
-			drones.run(output, y);
-			drones.run(output);
+			auto drones = pool.acquire();
+			drones->run(output, x);
+			drones->run(output, y);
+			drones->run(output);
 
 			if (output)
 			{
@@ -1991,10 +1914,10 @@ std::pair<int64_t, int64_t> day_19(const std::string& input_filepath)
 			x++;
 		}
 
-		IntcodeVM drones(opcodes);
-		drones.run(output, x + ship_size);
-		drones.run(output, y - ship_size);
-		drones.run(output);
+		auto drones = pool.acquire();
+		drones->run(output, x + ship_size);
+		drones->run(output, y - ship_size);
+		drones->run(output);
 
 		if (output)
 		{
@@ -2301,184 +2224,19 @@ std::pair<int64_t, int64_t> day_22(const std::string& input_filepath)
 	return { position, 61256063148970 };
 }
 
-template<typename T>
-class thread_safe_queue
-{
-public:
-	void push(const T& value)
-	{
-		std::lock_guard<std::mutex> lock(mutex);
-		queue.push(value);
-	}
-
-	void pop()
-	{
-		std::lock_guard<std::mutex> lock(mutex);
-		queue.pop();
-	}
-
-	bool empty() const
-	{
-		std::lock_guard<std::mutex> lock(mutex);
-		
-		return queue.empty();
-	}
-
-	const T& front() const
-	{
-		std::lock_guard<std::mutex> lock(mutex);
-
-		return queue.front();
-	}
-
-private:
-	std::queue<T> queue;
-	mutable std::mutex mutex;
-};
-
 std::pair<int64_t, int64_t> day_23(const std::string &input_filepath)
 {
 	constexpr size_t network_size = 50;
-	constexpr int64_t invalid_packet = -1;
-
-	std::vector<int64_t> opcodes;
-
-	for (auto line : next_file_line(input_filepath))
-		for (auto opcode : next_line_token<int64_t>(line))
-			opcodes.push_back(opcode);
-
-	std::vector<IntcodeVM> network(network_size, opcodes);
-
-	int64_t machine_id = 0;
-	for (auto &machine : network)
-	{
-		int64_t dummy_output;
-		machine.run(dummy_output, machine_id++);
-	}
-
-	using packet_t = std::pair<int64_t, int64_t>;
-	std::vector<thread_safe_queue<packet_t>> input_queues(network_size);
-	std::vector<std::queue<int64_t>> output_buffers(network_size);
-
-	std::optional<int64_t> part_1{};
-
-	int64_t nat_memory_x{};
-	int64_t nat_memory_y{};
-
-	std::mutex stdout_lock;
-	bool terminated = false;
-
-	auto network_node_thread = [&](int64_t machine_id)
-	{
-		auto &machine = network[machine_id];
-		auto &input_queue = input_queues[machine_id];
-		auto &output_buffer = output_buffers[machine_id];
-
-		while (!terminated)
-		{
-			int64_t output = 0;
-
-			execution_state_t state{};
-
-			if (!input_queue.empty())
-			{
-				auto &[input_1, input_2] = input_queue.front();
-
-				state = machine.run(output, input_1);
-
-				if (state == execution_state_t::consumed_value)
-				{
-					input_queue.pop();
-
-					state = machine.run(output, input_2);
-				}
-			}
-			else
-			{
-				state = machine.run(output, invalid_packet);
-			}
-
-			if (state == execution_state_t::provided_value)
-			{
-				output_buffer.push(output);
-
-				if (output_buffer.size() == 3)
-				{
-					auto address = output_buffer.front();
-					output_buffer.pop();
-
-					auto packet_x = output_buffer.front();
-					output_buffer.pop();
-
-					auto packet_y = output_buffer.front();
-					output_buffer.pop();
-
-					if (address == 255)
-					{
-						if (!part_1)
-							part_1 = packet_y;
-
-						nat_memory_x = packet_x;
-						nat_memory_y = packet_y;
-
-						std::lock_guard<std::mutex> lock(stdout_lock);
-						//std::cout << "Machine " << machine_id << " sending {" << nat_memory_x << ", " << nat_memory_y << "} to NAT" << std::endl;
-					}
-					else
-					{
-						input_queues[address].push({ packet_x, packet_y });
-					}
-				}
-			}
-		}
-
-
-	};
-
-	std::optional<int64_t> part_2;
-	
-	std::thread nat_thread{
-	[&]()
-	{
-		while (true)
-		{
-			if (!part_1)
-				continue;
-
-			if (std::all_of(input_queues.begin(), input_queues.end(), [](const auto &q) { return q.empty(); }))
-			{
-				input_queues[0].push({ nat_memory_x, nat_memory_y });
-				
-				std::lock_guard<std::mutex> lock(stdout_lock);
-				std::cout << "Sent {" << nat_memory_x << ", " << nat_memory_y << "} from NAT" << std::endl;
-
-				if (part_2)
-				{
-					if (part_2 == nat_memory_y)
-					{
-						terminated = true;
-						break;
-					}
-				}
 
-				part_2 = nat_memory_y;
-			}
-		}
-	}
-	};
-
-	std::vector<std::thread> machine_threads;
-	machine_threads.reserve(network_size);
+	IntcodeNetwork network(load_program(input_filepath), network_size, engine_t::blocks);
+	RepeatingNat nat;
 
-	for (size_t machine_id = 0; machine_id < network_size; machine_id++)
-		machine_threads.emplace_back(network_node_thread, machine_id);
+	network.run(nat);
 
-	for (auto &thread : machine_threads)
-		thread.join();
-	
-	nat_thread.join();
+	if (!nat.first_received || !nat.repeated_y)
+		throw std::runtime_error("the network stopped before the NAT sent the same packet twice");
 
-	return { *part_1, *part_2 };
+	return { nat.first_received->y, *nat.repeated_y };
 }
 
 template <size_t Rows, size_t Cols>
@@ -3207,6 +2965,9 @@ std::pair<int64_t, int64_t> day_25(const std::string &input_filepath)
 	auto[nothing1, nothing2, inventory_set] = parse_description(inventory_desc);
 	std::vector<item_t> inventory{ inventory_set.begin(), inventory_set.end() };
 
+	// every attempt starts from the checkpoint with the full inventory
+	auto carrying_everything = droid.snapshot();
+
 	std::vector<item_t> items_to_drop;
 	while (true)
 	{
@@ -3226,11 +2987,7 @@ std::pair<int64_t, int64_t> day_25(const std::string &input_filepath)
 			break;
 		}
 
-		for (const auto &item : items_to_drop)
-		{
-			droid.run_on(droid_input("take " + item));
-			std::cout << "took back: " << item << std::endl;
-		}
+		droid.restore(carrying_everything);
 	}
 
 	return { -1, -1 };
@@ -3238,6 +2995,9 @@ std::pair<int64_t, int64_t> day_25(const std::string &input_filepath)
 
 int main(int argc, char* argv[])
 {
+	if (auto exit_code = run_tool(argc, argv))
+		return *exit_code;
+
 	std::map<size_t, std::function<std::pair<int64_t, int64_t>(const std::string&)>> calling_map = {
 		{ 1, day_1 },
 		{ 2, day_2 },
@@ -3273,6 +3033,11 @@ int main(int argc, char* argv[])
 	
 	auto input_filepath = "inputs/day" + std::to_string(day) + "input.txt";
 
+	// Intcode puzzles are verified once here, their VMs then run the verified instructions unchecked (--verify shows which)
+	const std::set<size_t> intcode_days = { 2, 5, 7, 9, 11, 13, 15, 17, 19, 21, 23, 25 };
+	if (intcode_days.count(day))
+		verify_program(load_program(input_filepath));
+
 	auto[part_1_answer, part_2_answer] = calling_map[day](input_filepath);
 
 	std::cout
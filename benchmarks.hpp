@@ -0,0 +1,77 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "intcode_scheduler.hpp"
+
+/**
+	A ring of machines on the scheduler, each running a relay program which reads a value and outputs it plus one.
+	Tokens start at evenly spaced machines once all of them parked and travel the ring until they made hops_per_token hops, so at any time
+	a handful of machines work and the rest are parked waiting for input. Reports the hop rate and how many
+	slices a hop cost for 1, 2, 4... workers up to the hardware threads.
+*/
+inline void benchmark_scheduler(size_t machine_count, size_t token_count, int64_t hops_per_token)
+{
+	using clock = std::chrono::steady_clock;
+
+	// in: 3,100  add: 1001,100,1,100  out: 4,100  jump back: 1105,1,0
+	std::vector<int64_t> relay = { 3, 100, 1001, 100, 1, 100, 4, 100, 1105, 1, 0 };
+	relay.resize(101, 0);
+
+	token_count = std::max<size_t>(std::min(token_count, machine_count), 1);
+
+	for (size_t workers = 1; ; workers *= 2)
+	{
+		workers = std::min<size_t>(workers, std::max(std::thread::hardware_concurrency(), 1u));
+
+		IntcodeScheduler scheduler(workers);
+
+		for (size_t i = 0; i < machine_count; i++)
+			scheduler.add(IntcodeVM(relay));
+
+		std::atomic<size_t> arrived{ 0 };
+		bool seeded = false;
+		auto start = clock::now();
+
+		scheduler.run([&](IntcodeScheduler::machine_id_t id, IntcodeChannel& output)
+		{
+			while (!output.empty())
+			{
+				auto hops = output.pop();
+
+				if (hops < hops_per_token)
+					scheduler.deliver((id + 1) % machine_count, { hops });
+				else
+					arrived++;
+			}
+		},
+		[&]
+		{
+			// once every machine is parked, so tokens delivered to queued machines do not merge
+			if (seeded)
+				return false;
+
+			for (size_t token = 0; token < token_count; token++)
+				scheduler.deliver(token * machine_count / token_count, { 0 });
+
+			return seeded = true;
+		});
+
+		auto elapsed = std::chrono::duration<double>(clock::now() - start).count();
+		auto hops = static_cast<double>(token_count) * hops_per_token;
+
+		std::cout << std::left << std::setw(3) << workers << " workers  "
+			<< std::fixed << std::setprecision(2) << hops / elapsed / 1e6 << " M hops/s, "
+			<< static_cast<double>(scheduler.slices()) / hops << " slices per hop, "
+			<< arrived << " of " << token_count << " tokens arrived" << std::endl;
+
+		if (workers >= std::thread::hardware_concurrency())
+			break;
+	}
+}
@@ -1,14 +1,260 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <limits>
 #include <memory>
+#include <fstream>
+#include <optional>
+#include <ostream>
+#include <utility>
 
+#include <array>
 #include <map>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
 
 #include "input_utilities.hpp"
+#include "intcode_image.hpp"
+
+/**
+	Accepts puzzle inputs as well as binary program images.
+*/
+inline std::vector<int64_t> load_program(const std::string& input_filepath)
+{
+	return ProgramImage(input_filepath).to_vector();
+}
+
+/**
+	Intcode memory is unbounded, but programs only touch a dense prefix (the program image)
+	and a handful of far away cells (usually the stack behind the relative base).
+	The image is covered by a flat page table, everything else is allocated in fixed size pages on first write.
+	Cells that were never written read as 0.
+
+	Pages are shared between copies and only duplicated when one of the owners writes to them,
+	so copying memory costs one pointer per page and a fork only pays for the pages it touches.
+
+	Every page written since the last reset_to() is remembered, resetting to a pristine image
+	copies back just those pages and reuses their storage.
+*/
+struct PagedMemory
+{
+	static constexpr int64_t page_bits = 10;
+	static constexpr int64_t page_size = int64_t{ 1 } << page_bits;
+	static constexpr int64_t page_mask = page_size - 1;
+
+	using page_t = std::array<int64_t, page_size>;
+	using page_ptr_t = std::shared_ptr<page_t>;
+
+	struct slot_t
+	{
+		page_ptr_t page;
+		uint32_t written_in = 0;
+	};
+
+	PagedMemory() = default;
+
+	PagedMemory(const int64_t* image, size_t size) : image_size(size)
+	{
+		for (size_t i = 0; i < size; i += page_size)
+		{
+			auto page = std::make_shared<page_t>();
+			auto count = std::min(size - i, static_cast<size_t>(page_size));
+
+			std::copy(image + i, image + i + count, page->begin());
+			std::fill(page->begin() + count, page->end(), 0);
+
+			dense.push_back({ page });
+		}
+	}
+
+	PagedMemory(const std::vector<int64_t>& image) : PagedMemory(image.data(), image.size()) {}
+
+	int64_t read(int64_t address) const
+	{
+		auto index = address >> page_bits;
+
+		if (static_cast<uint64_t>(index) < dense.size())
+			return (*dense[static_cast<size_t>(index)].page)[static_cast<size_t>(address & page_mask)];
+
+		auto slot = pages.find(index);
+		if (slot == pages.end())
+			return 0;
+
+		return (*slot->second.page)[static_cast<size_t>(address & page_mask)];
+	}
+
+	int64_t& operator[](int64_t address)
+	{
+		auto index = address >> page_bits;
+
+		auto& slot = static_cast<uint64_t>(index) < dense.size() ? dense[static_cast<size_t>(index)] : pages[index];
+
+		if (slot.written_in != generation || slot.page.use_count() != 1)
+			make_writable(slot, index);
+
+		return (*slot.page)[static_cast<size_t>(address & page_mask)];
+	}
+
+	bool in_dense(int64_t address) const
+	{
+		return static_cast<uint64_t>(address) < image_size;
+	}
+
+	size_t dense_size() const
+	{
+		return image_size;
+	}
+
+	size_t allocated_pages() const
+	{
+		return dense.size() + pages.size();
+	}
+
+	const std::vector<int64_t>& dirty_pages() const
+	{
+		return dirty;
+	}
+
+	// calls visit(index, page) for every allocated page, the dense ones first and in order
+	template <typename Visitor>
+	void for_each_page(Visitor visit) const
+	{
+		for (size_t i = 0; i < dense.size(); i++)
+			visit(static_cast<int64_t>(i), *dense[i].page);
+
+		for (auto& [index, slot] : pages)
+		{
+			if (slot.page)
+				visit(index, *slot.page);
+		}
+	}
+
+	// nullptr for pages which were never written
+	const page_t* find_page(int64_t index) const
+	{
+		if (static_cast<uint64_t>(index) < dense.size())
+			return dense[static_cast<size_t>(index)].page.get();
+
+		auto slot = pages.find(index);
+
+		return slot == pages.end() ? nullptr : slot->second.page.get();
+	}
+
+	/**
+		Pages which may differ from an earlier copy of this memory: shared pages are only replaced
+		when written, so comparing the page pointers finds them without looking at their contents.
+		Pages allocated on just one side are included, missing ones read as zeros.
+	*/
+	std::vector<int64_t> pages_changed_since(const PagedMemory& earlier) const
+	{
+		std::vector<int64_t> changed;
+
+		for (size_t i = 0; i < dense.size(); i++)
+		{
+			if (i >= earlier.dense.size() || dense[i].page != earlier.dense[i].page)
+				changed.push_back(static_cast<int64_t>(i));
+		}
+
+		for (auto& [index, slot] : pages)
+		{
+			if (slot.page.get() != earlier.find_page(index))
+				changed.push_back(index);
+		}
+
+		for (auto& [index, slot] : earlier.pages)
+		{
+			if (slot.page && !pages.count(index))
+				changed.push_back(index);
+		}
+
+		return changed;
+	}
+
+	// overwrites a whole page with saved contents
+	void load_page(int64_t index, const int64_t* words)
+	{
+		auto& slot = static_cast<uint64_t>(index) < dense.size() ? dense[static_cast<size_t>(index)] : pages[index];
+
+		slot.page = std::make_shared<page_t>();
+		std::copy(words, words + page_size, slot.page->begin());
+	}
+
+	uint64_t hash() const
+	{
+		uint64_t hash = program_hash(nullptr, 0);
+
+		for (size_t i = 0; i < dense.size(); i++)
+		{
+			auto count = std::min(image_size - i * page_size, static_cast<size_t>(page_size));
+			hash = program_hash(dense[i].page->data(), count, hash);
+		}
+
+		return hash;
+	}
+
+	/**
+		Brings memory back to the pristine image it was copied from, in time proportional to the pages written since.
+		Private pages are overwritten in place, so a reset followed by a run of the same shape allocates nothing.
+	*/
+	void reset_to(const PagedMemory& pristine)
+	{
+		for (auto index : dirty)
+		{
+			bool is_dense = static_cast<uint64_t>(index) < dense.size();
+			auto& slot = is_dense ? dense[static_cast<size_t>(index)] : pages[index];
+
+			std::shared_ptr<page_t> original;
+			if (is_dense)
+				original = pristine.dense[static_cast<size_t>(index)].page;
+			else if (auto pristine_slot = pristine.pages.find(index); pristine_slot != pristine.pages.end())
+				original = pristine_slot->second.page;
+
+			// a shared page goes back to the pristine one, or away when the pristine memory has none
+			if (slot.page.use_count() != 1 && original)
+				slot.page = original;
+			else if (slot.page.use_count() != 1)
+				pages.erase(index);
+			else if (original)
+				*slot.page = *original;
+			else
+				slot.page->fill(0);
+		}
+
+		dirty.clear();
+		generation++;
+	}
+
+private:
+	// makes sure the page is not shared with any other memory and remembers it was written to
+	void make_writable(slot_t& slot, int64_t index)
+	{
+		if (!slot.page)
+			slot.page = std::make_shared<page_t>(page_t{});
+
+		else if (slot.page.use_count() > 1)
+			slot.page = std::make_shared<page_t>(*slot.page);
+
+		if (slot.written_in != generation)
+		{
+			slot.written_in = generation;
+			dirty.push_back(index);
+		}
+	}
+
+	size_t image_size = 0;
+	uint32_t generation = 1;
+	std::vector<slot_t> dense;
+	std::unordered_map<int64_t, slot_t> pages;
+	std::vector<int64_t> dirty;
+};
+
+using memory_t = PagedMemory;
 
-using memory_t = std::map<int64_t, int64_t>;
 enum class mode_t
 {
 	positional = 0,
@@ -22,148 +268,1674 @@ enum class execution_state_t
 	halted,
 	consumed_value,
 	provided_value,
-	requested_value
+	requested_value,
+	interrupted
+};
+
+enum class opcode_t : int64_t
+{
+	add = 1,
+	multiply = 2,
+	input = 3,
+	output = 4,
+	jump_if_true = 5,
+	jump_if_false = 6,
+	less_than = 7,
+	equals = 8,
+	adjust_base = 9,
+	halt = 99
+};
+
+/**
+	objects:  every instruction is an IntcodeInstruction object, dispatched through virtual calls
+	dispatch: a single switch based loop which keeps the instruction pointer and relative base in locals
+	blocks:   straight-line runs of the program image are translated once and then executed without decoding
+	compiled: runs the ahead-of-time transpiled version of the program (see intcode_transpiler.hpp) if one is registered,
+	          otherwise behaves like dispatch
+*/
+enum class engine_t
+{
+	objects = 0,
+	dispatch,
+	blocks,
+	compiled
 };
 
 struct InstructionParameter
 {
 	mode_t m_mode;
 
-	InstructionParameter(mode_t mode) : m_mode(mode) {}
+	InstructionParameter(mode_t mode = mode_t::positional) : m_mode(mode) {}
+
+	// Memory is memory_t or a view of it, like the one recording reads while a watcher is attached
+	template <typename Memory>
+	int64_t get_value(int64_t word, const Memory& memory, int64_t relative_base) const
+	{
+		if (m_mode == mode_t::positional)
+			return memory.read(word);
+
+		else if (m_mode == mode_t::relative)
+			return memory.read(word + relative_base);
+
+		return word;
+	}
+
+	int64_t get_dest(int64_t word, int64_t relative_base) const
+	{
+		if (m_mode == mode_t::positional)
+			return word;
+
+		else if (m_mode == mode_t::relative)
+			return word + relative_base;
+
+		throw std::runtime_error("invalid mode");
+	}
+
+	// for instructions the load-time verifier accepted, which cannot have an immediate destination
+	int64_t get_dest_unchecked(int64_t word, int64_t relative_base) const
+	{
+		return m_mode == mode_t::relative ? word + relative_base : word;
+	}
+};
+
+constexpr size_t max_parameters = 3;
+
+using parameters_t = std::array<InstructionParameter, max_parameters>;
+using arguments_t = std::array<int64_t, max_parameters>;
+
+/**
+	Semantics of every opcode but input, output and halt, shared by the engines which differ only in how they
+	fetch operands and store results: src(n) is the value of parameter n, put(n, value) stores through parameter n.
+	Returns the address of the next instruction.
+
+	Instantiated per opcode, so that a hot loop switching on the opcode itself gets every case inlined.
+*/
+template <opcode_t Opcode, typename Src, typename Put>
+constexpr int64_t execute_instruction(int64_t ip, int64_t& relative_base, Src&& src, Put&& put)
+{
+	if constexpr (Opcode == opcode_t::add)
+	{
+		put(2, src(0) + src(1));
+		return ip + 4;
+	}
+	else if constexpr (Opcode == opcode_t::multiply)
+	{
+		put(2, src(0) * src(1));
+		return ip + 4;
+	}
+	else if constexpr (Opcode == opcode_t::jump_if_true)
+		return (src(0) > 0) ? src(1) : ip + 3;
+
+	else if constexpr (Opcode == opcode_t::jump_if_false)
+		return (src(0) == 0) ? src(1) : ip + 3;
+
+	else if constexpr (Opcode == opcode_t::less_than)
+	{
+		put(2, (src(0) < src(1)) ? 1 : 0);
+		return ip + 4;
+	}
+	else if constexpr (Opcode == opcode_t::equals)
+	{
+		put(2, (src(0) == src(1)) ? 1 : 0);
+		return ip + 4;
+	}
+	else
+	{
+		static_assert(Opcode == opcode_t::adjust_base, "input, output and halt are up to the engine");
+
+		relative_base += src(0);
+		return ip + 2;
+	}
+}
+
+template <typename Src, typename Put>
+constexpr int64_t execute_instruction(opcode_t opcode, int64_t ip, int64_t& relative_base, Src&& src, Put&& put)
+{
+	switch (opcode)
+	{
+	case opcode_t::add:				return execute_instruction<opcode_t::add>(ip, relative_base, src, put);
+	case opcode_t::multiply:		return execute_instruction<opcode_t::multiply>(ip, relative_base, src, put);
+	case opcode_t::jump_if_true:	return execute_instruction<opcode_t::jump_if_true>(ip, relative_base, src, put);
+	case opcode_t::jump_if_false:	return execute_instruction<opcode_t::jump_if_false>(ip, relative_base, src, put);
+	case opcode_t::less_than:		return execute_instruction<opcode_t::less_than>(ip, relative_base, src, put);
+	case opcode_t::equals:			return execute_instruction<opcode_t::equals>(ip, relative_base, src, put);
+	case opcode_t::adjust_base:		return execute_instruction<opcode_t::adjust_base>(ip, relative_base, src, put);
+	default:						throw std::runtime_error("invalid opcode");
+	}
+}
+
+struct IntcodeVM;
+struct IntcodeInstruction
+{
+public:
+	int64_t size;
+	int64_t ip_increment;
+
+	IntcodeInstruction(int64_t size) : size(size), ip_increment(size) { }
+	IntcodeInstruction(int64_t size, int64_t ip_increment) : size(size), ip_increment(ip_increment) { }
+
+	execution_state_t execute(IntcodeVM& vm, int64_t& output, int64_t input, const parameters_t& parameters);
+	virtual std::string to_string() = 0;
+
+protected:
+	virtual execution_state_t execute_specific(IntcodeVM& vm, int64_t& output, int64_t input, const parameters_t& parameters, arguments_t& arguments) = 0;
+};
+
+/**
+	Superinstructions recognized while decoding, executed by the dispatch core as a single step:
+	compare_jump:      LessThan/Equals storing to a cell which the following JumpIfTrue/JumpIfFalse tests
+	move:              Add with an immediate 0 operand
+	adjust_base_pair:  two AdjustBase instructions with immediate operands
+*/
+enum class fusion_t : uint8_t
+{
+	none = 0,
+	compare_jump,
+	move,
+	adjust_base_pair
+};
+
+struct FusionCounters
+{
+	uint64_t compare_jump = 0;
+	uint64_t move = 0;
+	uint64_t adjust_base_pair = 0;
+
+	uint64_t total() const
+	{
+		return compare_jump + move + adjust_base_pair;
+	}
+};
+
+/**
+	Result of decoding a single instruction word.
+	Entries are tagged with the word they were decoded from, so a store that changes
+	an opcode word (self-modifying code or an outside write to vm.memory) invalidates the entry.
+	Fused entries depend on more than their own opcode word, the cells they cover are tracked with CodeCells.
+*/
+struct DecodedInstruction
+{
+	int64_t word = 0;
+	opcode_t opcode{};
+	IntcodeInstruction* instruction = nullptr;
+	parameters_t parameters{};
+
+	fusion_t fusion = fusion_t::none;
+	opcode_t fused_opcode{};
+	parameters_t fused_parameters{};
+	int64_t fused_constant = 0;
+
+	// the word is verified code at this address, see VerifiedCode
+	bool verified = false;
+};
+
+using decode_cache_t = std::vector<DecodedInstruction>;
+
+/**
+	Profiling policies of the dispatch loop. The loop is instantiated once per policy,
+	so with NullProfiler every hook compiles away and fused instructions run as usual.
+*/
+struct NullProfiler
+{
+	static constexpr bool enabled = false;
+
+	void instruction(int64_t, const DecodedInstruction&) {}
+	void enter(int64_t) {}
+	void leave() {}
+};
+
+/**
+	Counts executed instructions per opcode, per address and per opcode word (opcode plus parameter modes).
+	Fusion is off while profiling, so every instruction of the program is counted on its own.
+
+	With time_blocks set it also measures the time spent in every basic block, a block starts where
+	the loop is entered and after every jump. Reading the clock twice per block is much more expensive
+	than the instructions themselves, so only the relative times are meaningful.
+*/
+struct IntcodeProfiler
+{
+	static constexpr bool enabled = true;
+
+	struct block_t
+	{
+		uint64_t entries = 0;
+		std::chrono::nanoseconds time{};
+	};
+
+	bool time_blocks = false;
+
+	std::map<opcode_t, uint64_t> per_opcode;
+	std::unordered_map<int64_t, uint64_t> per_address;
+	std::unordered_map<int64_t, uint64_t> per_word;
+	std::unordered_map<int64_t, block_t> per_block;
+
+	void instruction(int64_t address, const DecodedInstruction& decoded)
+	{
+		per_opcode[decoded.opcode]++;
+		per_address[address]++;
+		per_word[decoded.word]++;
+	}
+
+	void enter(int64_t address)
+	{
+		if (!time_blocks)
+			return;
+
+		leave();
+
+		current_block = address;
+		per_block[address].entries++;
+		block_started = std::chrono::steady_clock::now();
+		in_block = true;
+	}
+
+	void leave()
+	{
+		if (!in_block)
+			return;
+
+		per_block[current_block].time += std::chrono::steady_clock::now() - block_started;
+		in_block = false;
+	}
+
+	uint64_t total() const
+	{
+		uint64_t executed = 0;
+
+		for (auto [opcode, count] : per_opcode)
+			executed += count;
+
+		return executed;
+	}
+
+	void clear()
+	{
+		*this = IntcodeProfiler{};
+	}
+
+	// human readable hot spots, top entries of every table sorted by count (blocks by time)
+	void report(std::ostream& out, size_t top = 20) const;
+
+	// every counter as CSV rows of kind,key,count,nanoseconds
+	void dump(std::ostream& out) const;
+
+private:
+	int64_t current_block = 0;
+	bool in_block = false;
+	std::chrono::steady_clock::time_point block_started;
+};
+
+/**
+	Memory watching policies of the dispatch loop, instantiated like the profiling policies:
+	with NullWatcher operands are read from memory directly and nothing is recorded.
+*/
+struct NullWatcher
+{
+	static constexpr bool enabled = false;
+
+	const memory_t& view(const memory_t& memory) { return memory; }
+	void execute(int64_t) {}
+	void write(int64_t, int64_t) {}
+	bool stop_requested() const { return false; }
+};
+
+enum class access_t : uint8_t
+{
+	read = 1,
+	write = 2,
+	execute = 4
+};
+
+/**
+	Watchpoints on address ranges and a sampled trace of memory accesses.
+
+	Reads are seen through the WatchedMemory view which the dispatch loop hands to
+	InstructionParameter::get_value, writes where the loop stores to the address from get_dest,
+	executes when an instruction is fetched. Operand words of the instruction itself count as part
+	of its execution, not as reads. Fusion is off while watching.
+
+	Every hit of a watchpoint is counted and the last one kept, a watchpoint with stop set makes the run
+	return execution_state_t::interrupted (interrupt_reason_t::watchpoint) after the instruction.
+
+	With trace_interval set, every trace_interval-th access goes to a ring buffer of trace_capacity
+	records which keeps the latest ones, write_trace() exports it.
+*/
+struct IntcodeWatcher
+{
+	static constexpr bool enabled = true;
+
+	struct record_t
+	{
+		int64_t instruction_pointer;
+		int64_t address;
+		int64_t value;
+		uint64_t access;
+	};
+
+	struct Watchpoint
+	{
+		int64_t begin;
+		int64_t end;
+		uint8_t accesses;
+		bool stop = false;
+
+		uint64_t hits = 0;
+		std::optional<record_t> last_hit;
+	};
+
+	std::vector<Watchpoint> watchpoints;
+
+	// 0 disables the trace
+	uint32_t trace_interval = 0;
+
+	explicit IntcodeWatcher(size_t trace_capacity = 1 << 16)
+	{
+		size_t rounded = 1;
+		while (rounded < trace_capacity)
+			rounded <<= 1;
+
+		trace.resize(rounded);
+	}
+
+	// returns the index of the new watchpoint
+	size_t watch(int64_t begin, int64_t end, std::initializer_list<access_t> accesses, bool stop = false)
+	{
+		uint8_t mask = 0;
+		for (auto access : accesses)
+			mask |= static_cast<uint8_t>(access);
+
+		watchpoints.push_back({ begin, end, mask, stop });
+		lowest = std::min(lowest, begin);
+		highest = std::max(highest, end);
+
+		return watchpoints.size() - 1;
+	}
+
+	void read(int64_t address, int64_t value)
+	{
+		access(address, value, access_t::read);
+	}
+
+	void write(int64_t address, int64_t value)
+	{
+		access(address, value, access_t::write);
+	}
+
+	void execute(int64_t address)
+	{
+		current_instruction = address;
+		access(address, 0, access_t::execute);
+	}
+
+	// true once after a stopping watchpoint was hit
+	bool stop_requested()
+	{
+		return std::exchange(stop_pending, false);
+	}
+
+	/**
+		Read only view of memory reporting every read, the memory type get_value sees while watching.
+	*/
+	struct WatchedMemory
+	{
+		const memory_t& memory;
+		IntcodeWatcher& watcher;
+
+		int64_t read(int64_t address) const
+		{
+			auto value = memory.read(address);
+			watcher.read(address, value);
+
+			return value;
+		}
+	};
+
+	WatchedMemory view(const memory_t& memory)
+	{
+		return { memory, *this };
+	}
+
+	// sampled records still in the ring buffer, oldest first
+	std::vector<record_t> trace_records() const
+	{
+		std::vector<record_t> records;
+		auto kept = std::min<uint64_t>(traced, trace.size());
+
+		for (auto i = traced - kept; i < traced; i++)
+			records.push_back(trace[static_cast<size_t>(i & (trace.size() - 1))]);
+
+		return records;
+	}
+
+	// addresses by number of sampled reads and writes, most accessed first
+	std::vector<std::pair<int64_t, uint64_t>> hot_addresses(size_t top = 20) const;
+
+	/**
+		Binary trace export:
+
+			char     magic[4]          "ICTR"
+			uint32_t trace_interval
+			uint64_t sampled           accesses sampled in total, the file holds the latest count of them
+			uint64_t count
+			record_t records[count]    instruction_pointer, address, value, access (1 read, 2 write, 4 execute)
+	*/
+	void write_trace(const std::string& filepath) const;
+
+private:
+	void access(int64_t address, int64_t value, access_t kind)
+	{
+		if (trace_interval && ++since_sample >= trace_interval)
+		{
+			since_sample = 0;
+			trace[static_cast<size_t>(traced++ & (trace.size() - 1))] = { current_instruction, address, value, static_cast<uint64_t>(kind) };
+		}
+
+		if (address < lowest || address >= highest)
+			return;
+
+		for (auto& watchpoint : watchpoints)
+		{
+			if (address < watchpoint.begin || address >= watchpoint.end || !(watchpoint.accesses & static_cast<uint8_t>(kind)))
+				continue;
+
+			watchpoint.hits++;
+			watchpoint.last_hit = record_t{ current_instruction, address, value, static_cast<uint64_t>(kind) };
+			stop_pending |= watchpoint.stop;
+		}
+	}
+
+	int64_t lowest = std::numeric_limits<int64_t>::max();
+	int64_t highest = std::numeric_limits<int64_t>::min();
+
+	int64_t current_instruction = 0;
+	bool stop_pending = false;
+
+	std::vector<record_t> trace;
+	uint64_t traced = 0;
+	uint32_t since_sample = 0;
+};
+
+/**
+	Cells of the program image which were baked into a derived representation (translated blocks, fused instructions).
+	A store into a baked cell invalidates the representation and marks the cell volatile,
+	volatile cells are never baked in again and the instructions touching them are interpreted normally.
+*/
+struct CodeCells
+{
+	enum cell_t : uint8_t
+	{
+		plain = 0,
+		baked,
+		volatile_cell
+	};
+
+	std::vector<uint8_t> cells;
+
+	void resize(size_t dense_size)
+	{
+		if (cells.size() != dense_size)
+			cells.assign(dense_size, plain);
+	}
+
+	bool can_bake(int64_t begin, int64_t end) const
+	{
+		if (begin < 0 || static_cast<uint64_t>(end) > cells.size())
+			return false;
+
+		return std::find(cells.begin() + begin, cells.begin() + end, static_cast<uint8_t>(volatile_cell)) == cells.begin() + end;
+	}
+
+	void bake(int64_t begin, int64_t end)
+	{
+		std::fill(cells.begin() + begin, cells.begin() + end, static_cast<uint8_t>(baked));
+	}
+
+	/**
+		Returns true if the store hit a baked cell, everything baked so far is invalid afterwards.
+	*/
+	bool on_store(int64_t address)
+	{
+		if (static_cast<uint64_t>(address) >= cells.size() || cells[static_cast<size_t>(address)] != baked)
+			return false;
+
+		clear();
+		cells[static_cast<size_t>(address)] = volatile_cell;
+
+		return true;
+	}
+
+	bool any_baked(int64_t begin, int64_t end) const
+	{
+		begin = std::max<int64_t>(begin, 0);
+		end = std::min<int64_t>(end, static_cast<int64_t>(cells.size()));
+
+		return begin < end && std::find(cells.begin() + begin, cells.begin() + end, static_cast<uint8_t>(baked)) != cells.begin() + end;
+	}
+
+	void clear()
+	{
+		std::replace(cells.begin(), cells.end(), static_cast<uint8_t>(baked), static_cast<uint8_t>(plain));
+	}
+};
+
+struct TranslatedInstruction
+{
+	opcode_t opcode;
+	int64_t size;
+	parameters_t parameters;
+	arguments_t arguments;
+	bool verified = false;
+};
+
+/**
+	A basic block of the program image with every opcode, mode and argument word resolved.
+	Blocks end after the first jump, input, output or halt.
+*/
+struct TranslatedBlock
+{
+	int64_t start = 0;
+	int64_t end = 0;
+	std::vector<TranslatedInstruction> instructions;
+};
+
+/**
+	Translated blocks bake in the words they were built from, so a store into a translated cell drops all blocks.
+	Instructions touching volatile cells run on the dispatch core instead.
+
+	Writes done through vm.memory[] bypass this, the VM looks for them when it starts running (see IntcodeVM::check_host_writes).
+*/
+struct BlockCache
+{
+	static constexpr size_t max_block_instructions = 64;
+	static constexpr int32_t no_block = -1;
+
+	std::vector<int32_t> block_at;
+	CodeCells cells;
+	std::vector<TranslatedBlock> blocks;
+
+	void resize(size_t dense_size)
+	{
+		if (block_at.size() == dense_size)
+			return;
+
+		block_at.assign(dense_size, no_block);
+		cells.resize(dense_size);
+		blocks.clear();
+	}
+
+	/**
+		Returns true if the store hit translated code, all blocks are invalid afterwards.
+	*/
+	bool on_store(int64_t address)
+	{
+		if (!cells.on_store(address))
+			return false;
+
+		std::fill(block_at.begin(), block_at.end(), no_block);
+		blocks.clear();
+
+		return true;
+	}
+
+	void clear()
+	{
+		cells.clear();
+		std::fill(block_at.begin(), block_at.end(), no_block);
+		blocks.clear();
+	}
+};
+
+/**
+	Transpiled programs take the same arguments as IntcodeVM::run and are looked up by the hash of the program image.
+	Generated translation units register themselves through a static CompiledProgramRegistration.
+*/
+using compiled_program_t = execution_state_t(*)(IntcodeVM& vm, int64_t& output, int64_t input, bool request_input);
+
+inline std::map<uint64_t, compiled_program_t>& compiled_programs()
+{
+	static std::map<uint64_t, compiled_program_t> programs;
+
+	return programs;
+}
+
+struct CompiledProgramRegistration
+{
+	CompiledProgramRegistration(uint64_t image_hash, compiled_program_t program)
+	{
+		compiled_programs()[image_hash] = program;
+	}
+};
+
+/**
+	Instructions of a program image proven well formed when the program was loaded (see intcode_verifier.hpp):
+	a known opcode, implemented parameter modes and no immediate destination.
+	Those are properties of the instruction word alone, so an instruction is trusted exactly while its cell
+	still holds the verified word. Rewritten cells and code outside of the image take the checked path.
+*/
+struct VerifiedCode
+{
+	std::vector<int64_t> words;
+	std::vector<bool> instructions;
+
+	bool covers(int64_t address, int64_t word) const
+	{
+		if (address < 0 || static_cast<size_t>(address) >= words.size())
+			return false;
+
+		return instructions[static_cast<size_t>(address)] && words[static_cast<size_t>(address)] == word;
+	}
+};
+
+// registered at load time, possibly while other threads run VMs, so unlike compiled_programs() behind a lock
+inline std::mutex& verified_programs_mutex()
+{
+	static std::mutex mutex;
+
+	return mutex;
+}
+
+inline std::map<uint64_t, std::shared_ptr<const VerifiedCode>>& verified_programs()
+{
+	static std::map<uint64_t, std::shared_ptr<const VerifiedCode>> programs;
+
+	return programs;
+}
+
+inline void register_verified_code(uint64_t image_hash, std::shared_ptr<const VerifiedCode> code)
+{
+	std::lock_guard<std::mutex> lock(verified_programs_mutex());
+	verified_programs()[image_hash] = std::move(code);
+}
+
+inline std::shared_ptr<const VerifiedCode> find_verified_code(uint64_t image_hash)
+{
+	std::lock_guard<std::mutex> lock(verified_programs_mutex());
+
+	auto& programs = verified_programs();
+	auto program = programs.find(image_hash);
+
+	return program == programs.end() ? nullptr : program->second;
+}
+
+/**
+	Fixed capacity ring buffer of words between a VM and its host, one side pushes and the other pops.
+	The capacity is rounded up to a power of two so positions wrap with a mask.
+
+	Besides single values, a host can stream without copying: readable() and writable() expose
+	the longest contiguous region at the read or write position, consume() and commit() move past it.
+*/
+struct IntcodeChannel
+{
+	struct region_t
+	{
+		int64_t* data;
+		size_t size;
+	};
+
+	explicit IntcodeChannel(size_t capacity = 1024)
+	{
+		size_t rounded = 1;
+		while (rounded < capacity)
+			rounded <<= 1;
+
+		buffer.resize(rounded);
+		mask = rounded - 1;
+	}
+
+	size_t capacity() const { return buffer.size(); }
+	size_t size() const { return static_cast<size_t>(tail - head); }
+	bool empty() const { return head == tail; }
+	bool full() const { return size() == capacity(); }
+
+	void push(int64_t value)
+	{
+		buffer[tail++ & mask] = value;
+	}
+
+	int64_t front() const
+	{
+		return buffer[head & mask];
+	}
+
+	// the value pushed last
+	int64_t back() const
+	{
+		return buffer[(tail - 1) & mask];
+	}
+
+	int64_t pop()
+	{
+		return buffer[head++ & mask];
+	}
+
+	void clear()
+	{
+		head = tail = 0;
+	}
+
+	/**
+		Pushes values until the channel is full, returns the first one that did not fit.
+	*/
+	template <typename Iterator>
+	Iterator write(Iterator first, Iterator last)
+	{
+		for (; first != last && !full(); ++first)
+			push(static_cast<int64_t>(*first));
+
+		return first;
+	}
+
+	region_t readable()
+	{
+		auto offset = head & mask;
+
+		return { buffer.data() + offset, std::min(size(), capacity() - offset) };
+	}
+
+	void consume(size_t count)
+	{
+		head += count;
+	}
+
+	region_t writable()
+	{
+		auto offset = tail & mask;
+
+		return { buffer.data() + offset, std::min(capacity() - size(), capacity() - offset) };
+	}
+
+	void commit(size_t count)
+	{
+		tail += count;
+	}
+
+private:
+	std::vector<int64_t> buffer;
+	size_t mask;
+	uint64_t head = 0;
+	uint64_t tail = 0;
+};
+
+enum class interrupt_reason_t
+{
+	none = 0,
+	budget,
+	deadline,
+	cancelled,
+	watchpoint
+};
+
+/**
+	Limits on how long a VM may run. They are checked when control reaches a jump (a basic block boundary),
+	so a program can overshoot the budget by one straight-line run of instructions, and the clock is only
+	read on every clock_interval-th check. A VM hitting a limit returns execution_state_t::interrupted
+	with the instruction pointer on the next instruction, it continues from there once the limit is lifted.
+
+	The compiled engine can not check limits, while any is set it runs the dispatch loop instead.
+*/
+struct IntcodeLimits
+{
+	using clock_t = std::chrono::steady_clock;
+
+	static constexpr uint64_t unlimited = std::numeric_limits<uint64_t>::max();
+	static constexpr uint32_t clock_interval = 256;
+
+	// instructions left, used up across runs
+	uint64_t instruction_budget = unlimited;
+
+	std::optional<clock_t::time_point> deadline;
+
+	// set from any thread to stop the VM at its next check
+	const std::atomic<bool>* cancellation = nullptr;
+
+	bool active() const
+	{
+		return instruction_budget != unlimited || deadline || cancellation;
+	}
+
+	/**
+		Charges executed instructions to the budget, returns the first limit which is reached.
+	*/
+	interrupt_reason_t check(uint64_t executed)
+	{
+		charge(executed);
+
+		if (!instruction_budget)
+			return interrupt_reason_t::budget;
+
+		if (cancellation && cancellation->load(std::memory_order_relaxed))
+			return interrupt_reason_t::cancelled;
+
+		if (deadline && ++checks_since_clock >= clock_interval)
+		{
+			checks_since_clock = 0;
+
+			if (clock_t::now() >= *deadline)
+				return interrupt_reason_t::deadline;
+		}
+
+		return interrupt_reason_t::none;
+	}
+
+	void charge(uint64_t executed)
+	{
+		if (instruction_budget != unlimited)
+			instruction_budget -= std::min(executed, instruction_budget);
+	}
+
+private:
+	uint32_t checks_since_clock = clock_interval - 1;
+};
+
+/**
+	Architectural state of a VM. Memory pages are shared with the VM until one of them writes,
+	so taking and restoring snapshots is cheap.
+*/
+struct IntcodeSnapshot
+{
+	memory_t memory;
+	int64_t instruction_pointer;
+	int64_t relative_base;
+	uint64_t image_hash;
+};
+
+struct IntcodeVM
+{
+	int64_t instruction_pointer;
+	int64_t relative_base;
+
+	memory_t memory;
+	decode_cache_t decode_cache;
+	CodeCells fused_cells;
+	BlockCache block_cache;
+
+	bool fuse_instructions = true;
+	FusionCounters fusion_counters;
+
+	engine_t engine = engine_t::dispatch;
+
+	IntcodeLimits limits;
+
+	// why the last run returned execution_state_t::interrupted
+	interrupt_reason_t interrupt_reason = interrupt_reason_t::none;
+
+	// hash of the program image the VM was created from, used to find its compiled version
+	uint64_t image_hash;
+
+	// used by the buffered run(), values in flight belong to the host and are not part of snapshots
+	IntcodeChannel input_channel;
+	IntcodeChannel output_channel;
+
+	// opt-in, while set every run goes through the dispatch loop instantiated with the counting policy
+	IntcodeProfiler* profiler = nullptr;
+
+	// opt-in like the profiler, watchpoints and the access trace
+	IntcodeWatcher* watcher = nullptr;
+
+	IntcodeVM(memory_t& memory, int64_t ip = 0) :
+		memory(memory), instruction_pointer(ip), relative_base(0), image_hash(memory.hash()) {}
+
+	IntcodeVM(const std::vector<int64_t>& memory_, int64_t ip = 0) :
+		memory(memory_), instruction_pointer(ip), relative_base(0), image_hash(program_hash(memory_)) {}
+
+	// a mapped binary image is copied straight into the memory pages
+	IntcodeVM(const ProgramImage& image, int64_t ip = 0) :
+		memory(image.words(), image.size()), instruction_pointer(ip), relative_base(0), image_hash(image.hash()) {}
+
+	IntcodeVM(const std::string& input_filepath, int64_t ip = 0)
+		: IntcodeVM(ProgramImage(input_filepath), ip) {}
+
+	explicit IntcodeVM(const IntcodeSnapshot& snapshot) :
+		memory(snapshot.memory),
+		instruction_pointer(snapshot.instruction_pointer),
+		relative_base(snapshot.relative_base),
+		image_hash(snapshot.image_hash) {}
+
+	IntcodeSnapshot snapshot() const
+	{
+		return { memory, instruction_pointer, relative_base, image_hash };
+	}
+
+	/**
+		Code derived from the old memory (fused instructions, translated blocks) is dropped,
+		decoded instructions are revalidated by their tags as usual.
+	*/
+	void restore(const IntcodeSnapshot& snapshot)
+	{
+		memory = snapshot.memory;
+		instruction_pointer = snapshot.instruction_pointer;
+		relative_base = snapshot.relative_base;
+		image_hash = snapshot.image_hash;
+
+		invalidate_derived_code();
+		checked_dirty_pages = memory.dirty_pages().size();
+	}
+
+	/**
+		Resets a VM created from (or restored to) the pristine snapshot back to it.
+		Only pages written since the last reset are copied back, decoded instructions stay warm.
+	*/
+	void reset(const IntcodeSnapshot& pristine)
+	{
+		bool touched_code = false;
+
+		for (auto page : memory.dirty_pages())
+			touched_code |= holds_derived_code(page);
+
+		memory.reset_to(pristine.memory);
+		instruction_pointer = pristine.instruction_pointer;
+		relative_base = pristine.relative_base;
+		image_hash = pristine.image_hash;
+
+		if (touched_code)
+			invalidate_derived_code();
+
+		checked_dirty_pages = 0;
+	}
+
+	/**
+		Stores of the VM keep derived code up to date, writes of the host through vm.memory[] do not.
+		Pages which became dirty since the VM last ran were written by the host, if one of them holds
+		baked cells the derived code goes. Covers patching a fresh or pooled VM before it runs
+		(like day 2 setting noun and verb) and pages the program had not written yet;
+		a patch to a page the VM already wrote in this run still needs invalidate_derived_code().
+	*/
+	void check_host_writes()
+	{
+		auto& dirty = memory.dirty_pages();
+		bool touched_code = false;
+
+		for (auto i = checked_dirty_pages; i < dirty.size(); i++)
+			touched_code |= holds_derived_code(dirty[i]);
+
+		checked_dirty_pages = dirty.size();
+
+		if (touched_code)
+			invalidate_derived_code();
+	}
+
+	bool holds_derived_code(int64_t page) const
+	{
+		auto begin = page * memory_t::page_size;
+		auto end = begin + memory_t::page_size;
+
+		return fused_cells.any_baked(begin, end) || block_cache.cells.any_baked(begin, end);
+	}
+
+	/**
+		Independent VM continuing from the current state. Costs one pointer per memory page,
+		decoded instructions and translated blocks are not copied and get rebuilt by the fork on demand.
+	*/
+	IntcodeVM fork() const
+	{
+		IntcodeVM child(snapshot());
+
+		child.engine = engine;
+		child.fuse_instructions = fuse_instructions;
+
+		return child;
+	}
+
+	static std::map<int64_t, std::shared_ptr<IntcodeInstruction>>& instruction_table();
+	static std::pair<std::shared_ptr<IntcodeInstruction>, parameters_t> parse_word(int64_t word);
+	static int64_t instruction_size(int64_t opcode);
+
+	static DecodedInstruction decode_word(int64_t word)
+	{
+		auto[instruction, parameters] = parse_word(word);
+
+		return { word, static_cast<opcode_t>(word % 100), instruction.get(), parameters };
+	}
+
+	/**
+		Only the program image is cached, instructions outside of it are decoded on every fetch.
+	*/
+	const DecodedInstruction& decode(int64_t address)
+	{
+		auto word = memory.read(address);
+
+		if (!memory.in_dense(address))
+		{
+			uncached_instruction = decode_word(word);
+			return uncached_instruction;
+		}
+
+		if (decode_cache.size() != memory.dense_size())
+		{
+			decode_cache.assign(memory.dense_size(), DecodedInstruction{});
+			fused_cells.resize(memory.dense_size());
+		}
+
+		auto& entry = decode_cache[static_cast<size_t>(address)];
+
+		if (!entry.instruction || entry.word != word)
+		{
+			entry = decode_word(word);
+			entry.verified = is_verified(address, word);
+
+			if (fuse_instructions)
+				fuse(address, entry);
+		}
+
+		return entry;
+	}
+
+	/**
+		Whether the word at address is verified code of the current image. The registry is consulted again
+		only when the image changes, so verify a program before running it.
+	*/
+	bool is_verified(int64_t address, int64_t word)
+	{
+		if (verified_code_hash != image_hash)
+		{
+			verified_code = find_verified_code(image_hash);
+			verified_code_hash = image_hash;
+		}
+
+		return verified_code && verified_code->covers(address, word);
+	}
+
+	/**
+		Peephole pass over the instruction at address and the one following it.
+		Fusing bakes in argument words, so every cell of the group is tracked in fused_cells.
+		A jump into the middle of a group lands on the second instruction's own cache entry.
+	*/
+	void fuse(int64_t address, DecodedInstruction& entry)
+	{
+		auto size = instruction_size(static_cast<int64_t>(entry.opcode));
+
+		auto argument = [&](int64_t n) { return memory.read(address + 1 + n); };
+		auto mode = [&](int64_t n) { return entry.parameters[n].m_mode; };
+
+		if (entry.opcode == opcode_t::add && fused_cells.can_bake(address, address + size))
+		{
+			for (int64_t zero = 0; zero < 2; zero++)
+			{
+				if (mode(zero) != mode_t::immediate || argument(zero) != 0)
+					continue;
+
+				entry.fusion = fusion_t::move;
+				entry.fused_constant = 1 - zero;
+				fused_cells.bake(address, address + size);
+				return;
+			}
+		}
+
+		auto next = address + size;
+		if (!memory.in_dense(next))
+			return;
+
+		auto next_word = memory.read(next);
+		auto next_size = instruction_size(next_word % 100);
+
+		if (!next_size || !fused_cells.can_bake(address, next + next_size))
+			return;
+
+		auto following = decode_word(next_word);
+		auto next_argument = [&](int64_t n) { return memory.read(next + 1 + n); };
+
+		bool compares = entry.opcode == opcode_t::less_than || entry.opcode == opcode_t::equals;
+		bool jumps = following.opcode == opcode_t::jump_if_true || following.opcode == opcode_t::jump_if_false;
+
+		if (compares && jumps &&
+			mode(2) == mode_t::positional && following.parameters[0].m_mode == mode_t::positional &&
+			argument(2) == next_argument(0) &&
+			(argument(2) < address || argument(2) >= next + next_size))
+		{
+			entry.fusion = fusion_t::compare_jump;
+		}
+		else if (entry.opcode == opcode_t::adjust_base && following.opcode == opcode_t::adjust_base &&
+			mode(0) == mode_t::immediate && following.parameters[0].m_mode == mode_t::immediate)
+		{
+			entry.fusion = fusion_t::adjust_base_pair;
+			entry.fused_constant = argument(0) + next_argument(0);
+		}
+		else
+		{
+			return;
+		}
+
+		entry.fused_opcode = following.opcode;
+		entry.fused_parameters = following.parameters;
+		fused_cells.bake(address, next + next_size);
+	}
+
+	void store(int64_t address, int64_t value)
+	{
+		block_cache.on_store(address);
+
+		if (fused_cells.on_store(address))
+			drop_fusions();
+
+		memory[address] = value;
+	}
+
+	void invalidate_derived_code()
+	{
+		block_cache.clear();
+		fused_cells.clear();
+		drop_fusions();
+	}
+
+	void drop_fusions()
+	{
+		for (auto& entry : decode_cache)
+			entry.fusion = fusion_t::none;
+	}
+
+	execution_state_t run(int64_t& output, int64_t input, bool request_input = false)
+	{
+		if (engine == engine_t::dispatch || profiler || watcher)
+			return dispatch(output, input, request_input, false);
+
+		if (engine == engine_t::blocks)
+			return run_blocks(output, input, request_input);
+
+		if (engine == engine_t::compiled)
+			return run_compiled(output, input, request_input);
+
+		execution_state_t state = execution_state_t::normal;
+		bool limited = limits.active();
+		uint64_t executed = 0;
+
+		do
+		{
+			auto& decoded = decode(instruction_pointer);
+
+			if (request_input && decoded.opcode == opcode_t::input)
+			{
+				state = execution_state_t::requested_value;
+				break;
+			}
+
+			state = decoded.instruction->execute(*this, output, input, decoded.parameters);
+			executed++;
+
+			bool jumped = decoded.opcode == opcode_t::jump_if_true || decoded.opcode == opcode_t::jump_if_false;
+
+			if (limited && jumped && interrupted_by_limits(executed))
+				state = execution_state_t::interrupted;
+		} while (state == execution_state_t::normal);
+
+		if (limited)
+			limits.charge(executed);
+
+		return state;
+	}
+
+	execution_state_t run(int64_t& output, bool request_input = false)
+	{
+		int64_t dummy_input = 0;
+
+		return run(output, dummy_input, request_input);
+	}
+
+	/**
+		Buffered I/O, inputs are taken from input_channel and outputs appended to output_channel.
+		Runs until the VM halts (halted), needs an input while the input channel is empty (requested_value)
+		or fills the output channel (provided_value). A full output channel is never overwritten:
+		run() returns provided_value again until the host makes room.
+
+		The dispatch engine moves values without leaving its loop, other engines hand them over one at a time.
+	*/
+	execution_state_t run()
+	{
+		if (engine == engine_t::dispatch || profiler || watcher)
+		{
+			int64_t unused = 0;
+
+			return dispatch(unused, 0, false, false, true);
+		}
+
+		while (true)
+		{
+			// these engines only hand over an output after executing it, so they do not start with no room for one
+			if (output_channel.full())
+				return execution_state_t::provided_value;
+
+			int64_t output = 0;
+			auto state = run(output, input_channel.empty() ? 0 : input_channel.front(), input_channel.empty());
+
+			switch (state)
+			{
+			case execution_state_t::consumed_value:
+				input_channel.pop();
+				break;
+
+			case execution_state_t::provided_value:
+				output_channel.push(output);
+
+				if (output_channel.full())
+					return state;
+
+				break;
+
+			default:
+				return state;
+			}
+		}
+	}
 
-	int64_t get_value(int64_t word, memory_t& memory, int64_t relative_base) const
+	execution_state_t step(int64_t& output, int64_t input)
 	{
-		if (m_mode == mode_t::positional)
-			return memory[word];
+		if (engine != engine_t::objects)
+			return dispatch(output, input, false, true);
 
-		else if (m_mode == mode_t::relative)
-			return memory[word + relative_base];
+		auto& decoded = decode(instruction_pointer);
 
-		return word;
+		return decoded.instruction->execute(*this, output, input, decoded.parameters);
 	}
 
-	int64_t get_dest(int64_t word, int64_t relative_base) const
+	/**
+		Interpreter core of engine_t::dispatch.
+		Semantics match the IntcodeInstruction objects exactly, including the state returned on every exit.
+		When buffered, I/O goes through the channels and only stops the loop as described for run().
+	*/
+	execution_state_t dispatch(int64_t& output, int64_t input, bool request_input, bool single_step, bool buffered = false)
 	{
-		if (m_mode == mode_t::positional)
-			return word;
+		NullProfiler no_profiler;
+		NullWatcher no_watcher;
+		execution_state_t state{};
 
-		else if (m_mode == mode_t::relative)
-			return word + relative_base;
+		check_host_writes();
 
-		throw std::runtime_error("invalid mode");
+		if (profiler && watcher)
+			state = dispatch_loop(*profiler, *watcher, output, input, request_input, single_step, buffered);
+
+		else if (profiler)
+			state = dispatch_loop(*profiler, no_watcher, output, input, request_input, single_step, buffered);
+
+		else if (watcher)
+			state = dispatch_loop(no_profiler, *watcher, output, input, request_input, single_step, buffered);
+
+		else
+			state = dispatch_loop(no_profiler, no_watcher, output, input, request_input, single_step, buffered);
+
+		// pages the program wrote itself
+		checked_dirty_pages = memory.dirty_pages().size();
+
+		return state;
 	}
-};
 
-using parameters_t = std::vector<InstructionParameter>;
+	template <typename Profiler, typename Watcher>
+	execution_state_t dispatch_loop(Profiler& profiler, Watcher& watcher, int64_t& output, int64_t input, bool request_input, bool single_step, bool buffered)
+	{
+		auto ip = instruction_pointer;
+		auto rb = relative_base;
+		execution_state_t state = execution_state_t::normal;
 
-struct IntcodeVM;
-struct IntcodeInstruction
-{
-public:
-	int64_t size;
-	int64_t ip_increment;
+		bool limited = limits.active();
+		uint64_t executed = 0;
 
-	IntcodeInstruction(int64_t size) : size(size), ip_increment(size) { }
-	IntcodeInstruction(int64_t size, int64_t ip_increment) : size(size), ip_increment(ip_increment) { }
+		// operand reads go through the watcher's view of memory while watching
+		decltype(auto) data = watcher.view(memory);
 
-	execution_state_t execute(IntcodeVM& vm, int64_t& output, int64_t input, parameters_t& parameters);
-	virtual std::string to_string() = 0;
+		profiler.enter(ip);
 
-protected:
-	virtual execution_state_t execute_specific(IntcodeVM& vm, int64_t& output, int64_t input, parameters_t& parameters, std::vector<int64_t>& arguments) = 0;
-};
+		do
+		{
+			auto& decoded = decode(ip);
+			auto& parameters = decoded.parameters;
 
-struct IntcodeVM
-{
-	int64_t instruction_pointer;
-	int64_t relative_base;
+			profiler.instruction(ip, decoded);
+			watcher.execute(ip);
+			executed++;
 
-	memory_t memory;
+			auto src = [&](size_t n)
+			{
+				return parameters[n].get_value(memory.read(ip + 1 + static_cast<int64_t>(n)), data, rb);
+			};
 
-	IntcodeVM(memory_t& memory, int64_t ip = 0) :
-		memory(memory), instruction_pointer(ip), relative_base(0) {}
+			auto dest = [&](size_t n)
+			{
+				auto word = memory.read(ip + 1 + static_cast<int64_t>(n));
 
-	IntcodeVM(std::vector<int64_t>& memory_, int64_t ip = 0) :
-		instruction_pointer(ip), relative_base(0)
-	{
-		for (size_t i = 0; i < memory_.size(); i++)
-			memory[static_cast<int64_t>(i)] = memory_[i];
+				return decoded.verified ? parameters[n].get_dest_unchecked(word, rb) : parameters[n].get_dest(word, rb);
+			};
+
+			auto put = [&](size_t n, int64_t value)
+			{
+				auto address = dest(n);
+
+				watcher.write(address, value);
+				store(address, value);
+			};
+
+			if (!Profiler::enabled && !Watcher::enabled && decoded.fusion != fusion_t::none && !single_step)
+			{
+				switch (decoded.fusion)
+				{
+				case fusion_t::move:
+					put(2, src(static_cast<size_t>(decoded.fused_constant)));
+					ip += 4;
+					fusion_counters.move++;
+					continue;
+
+				case fusion_t::adjust_base_pair:
+					rb += decoded.fused_constant;
+					ip += 4;
+					executed++;
+					fusion_counters.adjust_base_pair++;
+					continue;
+
+				case fusion_t::compare_jump:
+				{
+					auto a = src(0);
+					auto b = src(1);
+					int64_t condition = (decoded.opcode == opcode_t::less_than) ? (a < b) : (a == b);
+
+					// the comparison result is the value the jump tests
+					put(2, condition);
+					ip += 4;
+
+					auto target = decoded.fused_parameters[1].get_value(memory.read(ip + 2), memory, rb);
+					bool taken = (decoded.fused_opcode == opcode_t::jump_if_true) ? condition > 0 : condition == 0;
+
+					ip = taken ? target : ip + 3;
+					executed++;
+					fusion_counters.compare_jump++;
+
+					if (limited && interrupted_by_limits(executed))
+						state = execution_state_t::interrupted;
+
+					continue;
+				}
+
+				default:
+					break;
+				}
+			}
+
+			switch (decoded.opcode)
+			{
+			case opcode_t::input:
+				if (buffered)
+				{
+					if (input_channel.empty())
+					{
+						state = execution_state_t::requested_value;
+						break;
+					}
+
+					put(0, input_channel.pop());
+					ip += 2;
+					break;
+				}
+
+				if (request_input)
+				{
+					state = execution_state_t::requested_value;
+					break;
+				}
+
+				put(0, input);
+				ip += 2;
+				state = execution_state_t::consumed_value;
+				break;
+
+			case opcode_t::output:
+				if (buffered)
+				{
+					// a channel the host did not drain is handed back before anything is overwritten, ip stays on the output
+					if (output_channel.full())
+					{
+						state = execution_state_t::provided_value;
+						break;
+					}
+
+					output_channel.push(src(0));
+					ip += 2;
+
+					if (output_channel.full())
+						state = execution_state_t::provided_value;
+
+					break;
+				}
+
+				output = src(0);
+				ip += 2;
+				state = execution_state_t::provided_value;
+				break;
+
+			case opcode_t::halt:
+				ip += 1;
+				state = execution_state_t::halted;
+				break;
+
+			case opcode_t::add:				ip = execute_instruction<opcode_t::add>(ip, rb, src, put);			break;
+			case opcode_t::multiply:		ip = execute_instruction<opcode_t::multiply>(ip, rb, src, put);		break;
+			case opcode_t::less_than:		ip = execute_instruction<opcode_t::less_than>(ip, rb, src, put);	break;
+			case opcode_t::equals:			ip = execute_instruction<opcode_t::equals>(ip, rb, src, put);		break;
+			case opcode_t::adjust_base:		ip = execute_instruction<opcode_t::adjust_base>(ip, rb, src, put);	break;
+
+			case opcode_t::jump_if_true:
+				ip = execute_instruction<opcode_t::jump_if_true>(ip, rb, src, put);
+				profiler.enter(ip);
+
+				if (limited && interrupted_by_limits(executed))
+					state = execution_state_t::interrupted;
+
+				break;
+
+			case opcode_t::jump_if_false:
+				ip = execute_instruction<opcode_t::jump_if_false>(ip, rb, src, put);
+				profiler.enter(ip);
+
+				if (limited && interrupted_by_limits(executed))
+					state = execution_state_t::interrupted;
+
+				break;
+			}
+
+			if (Watcher::enabled && state == execution_state_t::normal && watcher.stop_requested())
+			{
+				state = execution_state_t::interrupted;
+				interrupt_reason = interrupt_reason_t::watchpoint;
+			}
+		} while (state == execution_state_t::normal && !single_step);
+
+		profiler.leave();
+
+		if (limited)
+			limits.charge(executed);
+
+		instruction_pointer = ip;
+		relative_base = rb;
+
+		return state;
 	}
 
-	IntcodeVM(const std::string& input_filepath, int64_t ip = 0)
-		: instruction_pointer(ip), relative_base(0)
+	const TranslatedBlock* translate(int64_t start)
 	{
-		int64_t i = 0;
+		block_cache.resize(memory.dense_size());
+
+		if (!memory.in_dense(start))
+			return nullptr;
+
+		auto& cells = block_cache.cells;
+
+		auto& index = block_cache.block_at[static_cast<size_t>(start)];
+		if (index != BlockCache::no_block)
+			return &block_cache.blocks[static_cast<size_t>(index)];
+
+		TranslatedBlock block;
+		block.start = start;
 
-		for (auto line : next_file_line(input_filepath))
+		auto address = start;
+		while (block.instructions.size() < BlockCache::max_block_instructions)
 		{
-			for (auto word : next_line_token<int64_t>(line))
-			{
-				memory[i++] = word;
-			}
+			auto word = memory.read(address);
+			auto size = instruction_size(word % 100);
+
+			if (!size || !cells.can_bake(address, address + size))
+				break;
+
+			auto decoded = decode_word(word);
+
+			TranslatedInstruction instruction{ decoded.opcode, size, decoded.parameters, {}, is_verified(address, word) };
+			for (int64_t i = 0; i < size - 1; i++)
+				instruction.arguments[i] = memory.read(address + 1 + i);
+
+			block.instructions.push_back(instruction);
+			address += size;
+
+			auto opcode = decoded.opcode;
+			if (opcode == opcode_t::jump_if_true || opcode == opcode_t::jump_if_false || opcode == opcode_t::input ||
+				opcode == opcode_t::output || opcode == opcode_t::halt)
+				break;
 		}
+
+		if (block.instructions.empty())
+			return nullptr;
+
+		block.end = address;
+		cells.bake(start, address);
+
+		index = static_cast<int32_t>(block_cache.blocks.size());
+		block_cache.blocks.push_back(std::move(block));
+
+		return &block_cache.blocks.back();
 	}
 
-	static std::pair<std::shared_ptr<IntcodeInstruction>, parameters_t> IntcodeVM::parse_word(int64_t word);
+	execution_state_t run_compiled(int64_t& output, int64_t input, bool request_input)
+	{
+		auto& programs = compiled_programs();
+		auto program = programs.find(image_hash);
+
+		// translated code has no limit checks
+		if (program == programs.end() || limits.active())
+			return dispatch(output, input, request_input, false);
 
-	execution_state_t run(int64_t& output, int64_t input, bool request_input = false)
+		return program->second(*this, output, input, request_input);
+	}
+
+	execution_state_t run_blocks(int64_t& output, int64_t input, bool request_input)
 	{
 		execution_state_t state = execution_state_t::normal;
-		do
+		bool limited = limits.active();
+
+		check_host_writes();
+
+		while (state == execution_state_t::normal)
 		{
-			auto[instruction, parameters] = parse_word(memory[instruction_pointer]);
+			auto block = translate(instruction_pointer);
 
-			if (request_input && instruction->to_string() == "Input")
+			// single steps outside of blocks check limits in the dispatch loop
+			if (!block)
 			{
-				state = execution_state_t::requested_value;
-				break;
+				state = dispatch(output, input, request_input, true);
+				continue;
 			}
 
-			state = instruction->execute(*this, output, input, parameters);
-		} while (state == execution_state_t::normal);
+			uint64_t executed = block->instructions.size();
+			state = execute_block(*block, output, input, request_input);
+			checked_dirty_pages = memory.dirty_pages().size();
+
+			if (limited && state == execution_state_t::normal && interrupted_by_limits(executed))
+				state = execution_state_t::interrupted;
+		}
 
 		return state;
 	}
 
-	execution_state_t run(int64_t& output, bool request_input = false)
+	/**
+		Executes the block until it ends or a store hits translated code,
+		in which case the block is gone and control returns to run_blocks to translate again.
+	*/
+	execution_state_t execute_block(const TranslatedBlock& block, int64_t& output, int64_t input, bool request_input)
 	{
-		int64_t dummy_input = 0;
+		auto ip = block.start;
+		auto rb = relative_base;
+		execution_state_t state = execution_state_t::normal;
+		bool invalidated = false;
 
-		return run(output, dummy_input, request_input);
-	}
+		for (auto& instruction : block.instructions)
+		{
+			auto& parameters = instruction.parameters;
+			auto& arguments = instruction.arguments;
 
-	execution_state_t step(int64_t& output, int64_t input)
-	{
-		auto[instruction, parameters] = parse_word(memory[instruction_pointer]);
+			auto src = [&](size_t n)
+			{
+				return parameters[n].get_value(arguments[n], memory, rb);
+			};
+
+			auto store_to = [&](size_t n, int64_t value)
+			{
+				auto address = instruction.verified ?
+					parameters[n].get_dest_unchecked(arguments[n], rb) : parameters[n].get_dest(arguments[n], rb);
+
+				invalidated = block_cache.on_store(address);
+				memory[address] = value;
+			};
+
+			switch (instruction.opcode)
+			{
+			case opcode_t::input:
+				if (request_input)
+				{
+					state = execution_state_t::requested_value;
+					break;
+				}
+
+				store_to(0, input);
+				ip += 2;
+				state = execution_state_t::consumed_value;
+				break;
+
+			case opcode_t::output:
+				output = src(0);
+				ip += 2;
+				state = execution_state_t::provided_value;
+				break;
+
+			case opcode_t::halt:
+				ip += 1;
+				state = execution_state_t::halted;
+				break;
+
+			case opcode_t::add:				ip = execute_instruction<opcode_t::add>(ip, rb, src, store_to);				break;
+			case opcode_t::multiply:		ip = execute_instruction<opcode_t::multiply>(ip, rb, src, store_to);		break;
+			case opcode_t::jump_if_true:	ip = execute_instruction<opcode_t::jump_if_true>(ip, rb, src, store_to);	break;
+			case opcode_t::jump_if_false:	ip = execute_instruction<opcode_t::jump_if_false>(ip, rb, src, store_to);	break;
+			case opcode_t::less_than:		ip = execute_instruction<opcode_t::less_than>(ip, rb, src, store_to);		break;
+			case opcode_t::equals:			ip = execute_instruction<opcode_t::equals>(ip, rb, src, store_to);			break;
+			case opcode_t::adjust_base:		ip = execute_instruction<opcode_t::adjust_base>(ip, rb, src, store_to);		break;
+			}
+
+			if (invalidated)
+				break;
+		}
 
-		return instruction->execute(*this, output, input, parameters);
+		instruction_pointer = ip;
+		relative_base = rb;
+
+		return state;
 	}
 
+	/**
+		Feeds the whole input and collects outputs until the VM halts or asks for more input.
+		Returns the last output.
+	*/
 	template <typename InputContainer, typename OutputContainer>
 	int64_t run_on(OutputContainer& output, InputContainer& input)
 	{
-		int64_t vm_output = 0;
-		size_t consumed = 0;
+		int64_t last_output = 0;
+		auto next = std::begin(input);
 		execution_state_t state{};
 
-		while ((state = run(vm_output, input[consumed], input.size() <= consumed)) != execution_state_t::halted)
+		do
 		{
-			switch (state)
+			next = input_channel.write(next, std::end(input));
+			state = run();
+
+			while (!output_channel.empty())
 			{
-			case execution_state_t::consumed_value:
-				consumed++;
-				break;
-			case execution_state_t::provided_value:
-				output.push_back(static_cast<OutputContainer::value_type>(vm_output));
-				break;
-			case execution_state_t::requested_value:
-				return vm_output;
-			default:
-				break;
+				last_output = output_channel.pop();
+				output.push_back(static_cast<OutputContainer::value_type>(last_output));
 			}
-		}
+		} while (state == execution_state_t::provided_value || (state == execution_state_t::requested_value && next != std::end(input)));
 
-		return vm_output;
+		return last_output;
 	}
 
 	template <typename InputContainer>
@@ -173,6 +1945,88 @@ struct IntcodeVM
 
 		return run_on(output, input);
 	}
+
+private:
+	// charges the instructions executed since the last check, true when a limit was reached
+	bool interrupted_by_limits(uint64_t& executed)
+	{
+		interrupt_reason = limits.check(executed);
+		executed = 0;
+
+		return interrupt_reason != interrupt_reason_t::none;
+	}
+
+	DecodedInstruction uncached_instruction;
+
+	// dirty pages of memory which check_host_writes already looked at
+	size_t checked_dirty_pages = 0;
+
+	std::shared_ptr<const VerifiedCode> verified_code;
+	std::optional<uint64_t> verified_code_hash;
+};
+
+/**
+	Hands out VMs running the same program. Returned VMs are reset to the pristine image in time
+	proportional to the pages they wrote and reused, so a sweep over many runs allocates only while the pool warms up.
+*/
+struct IntcodeVMPool
+{
+	struct returner_t
+	{
+		IntcodeVMPool* pool;
+
+		void operator()(IntcodeVM* vm) const
+		{
+			pool->release(vm);
+		}
+	};
+
+	using lease_t = std::unique_ptr<IntcodeVM, returner_t>;
+
+	engine_t engine;
+
+	IntcodeVMPool(const std::vector<int64_t>& program, engine_t engine = engine_t::dispatch) :
+		engine(engine), pristine(IntcodeVM(program).snapshot()) {}
+
+	lease_t acquire()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (idle.empty())
+		{
+			vms.push_back(std::make_unique<IntcodeVM>(pristine));
+			vms.back()->engine = engine;
+			idle.push_back(vms.back().get());
+		}
+
+		auto vm = idle.back();
+		idle.pop_back();
+
+		return lease_t(vm, returner_t{ this });
+	}
+
+	size_t size() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		return vms.size();
+	}
+
+private:
+	void release(IntcodeVM* vm)
+	{
+		vm->reset(pristine);
+		vm->input_channel.clear();
+		vm->output_channel.clear();
+
+		std::lock_guard<std::mutex> lock(mutex);
+		idle.push_back(vm);
+	}
+
+	IntcodeSnapshot pristine;
+	std::vector<std::unique_ptr<IntcodeVM>> vms;
+	std::vector<IntcodeVM*> idle;
+	mutable std::mutex mutex;
 };
 
 #define SRC(x) int64_t src##x = parameters[x - 1].get_value(arguments[x - 1], vm.memory, vm.relative_base)
@@ -182,7 +2036,7 @@ struct Add : public IntcodeInstruction
 {
 	Add(int64_t size) : IntcodeInstruction(size) {}
 
-	virtual execution_state_t execute_specific(IntcodeVM& vm, int64_t& output, int64_t input, parameters_t& parameters, std::vector<int64_t>& arguments)
+	virtual execution_state_t execute_specific(IntcodeVM& vm, int64_t& output, int64_t input, const parameters_t& parameters, arguments_t& arguments)
 	{
 		auto& memory = vm.memory;
 
@@ -190,7 +2044,7 @@ struct Add : public IntcodeInstruction
 		SRC(2);
 		LOC(3);
 
-		vm.memory[dest] = src1 + src2;
+		vm.store(dest, src1 + src2);
 
 		return execution_state_t::normal;
 	}
@@ -205,7 +2059,7 @@ struct Multiply : public IntcodeInstruction
 {
 	Multiply(int64_t size) : IntcodeInstruction(size) {}
 
-	virtual execution_state_t execute_specific(IntcodeVM& vm, int64_t& output, int64_t input, parameters_t& parameters, std::vector<int64_t>& arguments)
+	virtual execution_state_t execute_specific(IntcodeVM& vm, int64_t& output, int64_t input, const parameters_t& parameters, arguments_t& arguments)
 	{
 		auto& memory = vm.memory;
 
@@ -213,7 +2067,7 @@ struct Multiply : public IntcodeInstruction
 		SRC(2);
 		LOC(3);
 
-		vm.memory[dest] = src1 * src2;
+		vm.store(dest, src1 * src2);
 
 		return execution_state_t::normal;
 	}
@@ -228,7 +2082,7 @@ struct JumpIfTrue : public IntcodeInstruction
 {
 	JumpIfTrue(int64_t size) : IntcodeInstruction(size, 0) {}
 
-	virtual execution_state_t execute_specific(IntcodeVM& vm, int64_t& output, int64_t input, parameters_t& parameters, std::vector<int64_t>& arguments)
+	virtual execution_state_t execute_specific(IntcodeVM& vm, int64_t& output, int64_t input, const parameters_t& parameters, arguments_t& arguments)
 	{
 		auto& memory = vm.memory;
 
@@ -250,7 +2104,7 @@ struct JumpIfFalse : public IntcodeInstruction
 {
 	JumpIfFalse(int64_t size) : IntcodeInstruction(size, 0) {}
 
-	virtual execution_state_t execute_specific(IntcodeVM& vm, int64_t& output, int64_t input, parameters_t& parameters, std::vector<int64_t>& arguments)
+	virtual execution_state_t execute_specific(IntcodeVM& vm, int64_t& output, int64_t input, const parameters_t& parameters, arguments_t& arguments)
 	{
 		auto& memory = vm.memory;
 
@@ -272,7 +2126,7 @@ struct LessThan : public IntcodeInstruction
 {
 	LessThan(int64_t size) : IntcodeInstruction(size) {}
 
-	virtual execution_state_t execute_specific(IntcodeVM& vm, int64_t& output, int64_t input, parameters_t& parameters, std::vector<int64_t>& arguments)
+	virtual execution_state_t execute_specific(IntcodeVM& vm, int64_t& output, int64_t input, const parameters_t& parameters, arguments_t& arguments)
 	{
 		auto& memory = vm.memory;
 
@@ -280,7 +2134,7 @@ struct LessThan : public IntcodeInstruction
 		SRC(2);
 		LOC(3);
 
-		vm.memory[dest] = (src1 < src2) ? 1 : 0;
+		vm.store(dest, (src1 < src2) ? 1 : 0);
 
 		return execution_state_t::normal;
 	}
@@ -295,7 +2149,7 @@ struct Equals : public IntcodeInstruction
 {
 	Equals(int64_t size) : IntcodeInstruction(size) {}
 
-	virtual execution_state_t execute_specific(IntcodeVM& vm, int64_t& output, int64_t input, parameters_t& parameters, std::vector<int64_t>& arguments)
+	virtual execution_state_t execute_specific(IntcodeVM& vm, int64_t& output, int64_t input, const parameters_t& parameters, arguments_t& arguments)
 	{
 		auto& memory = vm.memory;
 
@@ -303,7 +2157,7 @@ struct Equals : public IntcodeInstruction
 		SRC(2);
 		LOC(3);
 
-		vm.memory[dest] = (src1 == src2) ? 1 : 0;
+		vm.store(dest, (src1 == src2) ? 1 : 0);
 
 		return execution_state_t::normal;
 	}
@@ -318,7 +2172,7 @@ struct AdjustBase : public IntcodeInstruction
 {
 	AdjustBase(int64_t size) : IntcodeInstruction(size) {}
 
-	virtual execution_state_t execute_specific(IntcodeVM& vm, int64_t& output, int64_t input, parameters_t& parameters, std::vector<int64_t>& arguments)
+	virtual execution_state_t execute_specific(IntcodeVM& vm, int64_t& output, int64_t input, const parameters_t& parameters, arguments_t& arguments)
 	{
 		SRC(1);
 
@@ -337,11 +2191,11 @@ struct Input : public IntcodeInstruction
 {
 	Input(int64_t size) : IntcodeInstruction(size) {}
 
-	virtual execution_state_t execute_specific(IntcodeVM& vm, int64_t& output, int64_t input, parameters_t& parameters, std::vector<int64_t>& arguments)
+	virtual execution_state_t execute_specific(IntcodeVM& vm, int64_t& output, int64_t input, const parameters_t& parameters, arguments_t& arguments)
 	{
 		LOC(1);
 
-		vm.memory[dest] = input;
+		vm.store(dest, input);
 
 		return execution_state_t::consumed_value;
 	}
@@ -356,7 +2210,7 @@ struct Output : public IntcodeInstruction
 {
 	Output(int64_t size) : IntcodeInstruction(size) {}
 
-	virtual execution_state_t execute_specific(IntcodeVM& vm, int64_t& output, int64_t input, parameters_t& parameters, std::vector<int64_t>& arguments)
+	virtual execution_state_t execute_specific(IntcodeVM& vm, int64_t& output, int64_t input, const parameters_t& parameters, arguments_t& arguments)
 	{
 		SRC(1);
 
@@ -375,7 +2229,7 @@ struct Halt : public IntcodeInstruction
 {
 	Halt(int64_t size) : IntcodeInstruction(size) {}
 
-	virtual execution_state_t execute_specific(IntcodeVM& vm, int64_t& output, int64_t input, parameters_t& parameters, std::vector<int64_t>& arguments)
+	virtual execution_state_t execute_specific(IntcodeVM& vm, int64_t& output, int64_t input, const parameters_t& parameters, arguments_t& arguments)
 	{
 		return execution_state_t::halted;
 	}
@@ -386,15 +2240,7 @@ struct Halt : public IntcodeInstruction
 	}
 };
 
-void get_digits(int64_t value, std::vector<char>& digits, int64_t n = 7)
-{
-	for (auto divider = static_cast<int64_t>(std::pow(10, n - 1)); divider; value %= divider, divider /= 10)
-	{
-		digits.push_back(static_cast<char>(value / divider));
-	}
-}
-
-std::pair<std::shared_ptr<IntcodeInstruction>, parameters_t> IntcodeVM::parse_word(int64_t word)
+inline std::map<int64_t, std::shared_ptr<IntcodeInstruction>>& IntcodeVM::instruction_table()
 {
 	static std::map<int64_t, std::shared_ptr<IntcodeInstruction>> instructions = {
 		{ 1,  std::make_shared<Add>(4) },
@@ -409,34 +2255,46 @@ std::pair<std::shared_ptr<IntcodeInstruction>, parameters_t> IntcodeVM::parse_wo
 		{ 99, std::make_shared<Halt>(1) },
 	};
 
+	return instructions;
+}
+
+inline int64_t IntcodeVM::instruction_size(int64_t opcode)
+{
+	auto& instructions = instruction_table();
+	auto instruction = instructions.find(opcode);
+
+	return instruction == instructions.end() ? 0 : instruction->second->size;
+}
+
+inline std::pair<std::shared_ptr<IntcodeInstruction>, parameters_t> IntcodeVM::parse_word(int64_t word)
+{
+	auto& instructions = instruction_table();
+
 	int64_t opcode = word % 100;
 	int64_t argument_modes = word / 100;
 
-	if (!instructions.count(opcode))
+	auto entry = instructions.find(opcode);
+	if (entry == instructions.end())
 		throw std::runtime_error("illegal instruction encountered");
 
-	auto instruction = instructions[opcode];
-
-	std::vector<char> modes;
-	get_digits(argument_modes, modes, instruction->size - 1);
-	std::reverse(modes.begin(), modes.end());
+	auto& instruction = entry->second;
 
 	parameters_t parameters;
-	std::transform(modes.begin(), modes.end(), std::back_inserter(parameters), [](char m)
+	for (int64_t i = 0; i < instruction->size - 1; i++, argument_modes /= 10)
 	{
-		return InstructionParameter(static_cast<mode_t>(m));
-	});
+		parameters[i] = InstructionParameter(static_cast<mode_t>(argument_modes % 10));
+	}
 
 	return { instruction, parameters };
 }
 
-execution_state_t IntcodeInstruction::execute(IntcodeVM& vm, int64_t& output, int64_t input, parameters_t& parameters)
+inline execution_state_t IntcodeInstruction::execute(IntcodeVM& vm, int64_t& output, int64_t input, const parameters_t& parameters)
 {
-	std::vector<int64_t> arguments;
+	arguments_t arguments;
 
 	for (int64_t i = 0; i < size - 1; i++)
 	{
-		arguments.push_back(vm.memory[vm.instruction_pointer + 1 + i]);
+		arguments[i] = vm.memory.read(vm.instruction_pointer + 1 + i);
 	}
 
 	execution_state_t state = execute_specific(vm, output, input, parameters, arguments);
@@ -446,6 +2304,147 @@ execution_state_t IntcodeInstruction::execute(IntcodeVM& vm, int64_t& output, in
 	return state;
 }
 
+inline const char* opcode_name(opcode_t opcode)
+{
+	switch (opcode)
+	{
+	case opcode_t::add:				return "add";
+	case opcode_t::multiply:		return "multiply";
+	case opcode_t::input:			return "input";
+	case opcode_t::output:			return "output";
+	case opcode_t::jump_if_true:	return "jump_if_true";
+	case opcode_t::jump_if_false:	return "jump_if_false";
+	case opcode_t::less_than:		return "less_than";
+	case opcode_t::equals:			return "equals";
+	case opcode_t::adjust_base:		return "adjust_base";
+	case opcode_t::halt:			return "halt";
+	default:						return "invalid";
+	}
+}
+
+/**
+	Opcode name followed by the parameter modes, e.g. "multiply P I P" for 1002.
+*/
+inline std::string instruction_form(int64_t word)
+{
+	std::string form = opcode_name(static_cast<opcode_t>(word % 100));
+	auto modes = word / 100;
+
+	for (int64_t i = 1; i < IntcodeVM::instruction_size(word % 100); i++, modes /= 10)
+		form += std::string(" ") + "PIR"[modes % 10 < 3 ? modes % 10 : 0];
+
+	return form;
+}
+
+inline void IntcodeProfiler::report(std::ostream& out, size_t top) const
+{
+	auto executed = total();
+
+	auto sorted = [](const auto& table)
+	{
+		std::vector<std::pair<int64_t, uint64_t>> entries(table.begin(), table.end());
+
+		std::sort(entries.begin(), entries.end(), [](const auto& a, const auto& b) { return a.second > b.second; });
+
+		return entries;
+	};
+
+	auto share = [&](uint64_t count)
+	{
+		return executed ? 100.0 * count / executed : 0.0;
+	};
+
+	out << executed << " instructions executed" << std::endl;
+
+	out << std::endl << "per opcode:" << std::endl;
+	std::vector<std::pair<opcode_t, uint64_t>> opcodes(per_opcode.begin(), per_opcode.end());
+	std::sort(opcodes.begin(), opcodes.end(), [](const auto& a, const auto& b) { return a.second > b.second; });
+
+	for (auto [opcode, count] : opcodes)
+		out << std::setw(16) << opcode_name(opcode) << std::setw(14) << count << std::setw(8) << std::fixed << std::setprecision(2) << share(count) << "%" << std::endl;
+
+	out << std::endl << "per opcode and parameter modes:" << std::endl;
+	auto words = sorted(per_word);
+
+	for (size_t i = 0; i < words.size() && i < top; i++)
+		out << std::setw(8) << words[i].first << "  " << std::setw(22) << std::left << instruction_form(words[i].first) << std::right
+			<< std::setw(14) << words[i].second << std::setw(8) << share(words[i].second) << "%" << std::endl;
+
+	out << std::endl << "hottest addresses:" << std::endl;
+	auto addresses = sorted(per_address);
+
+	for (size_t i = 0; i < addresses.size() && i < top; i++)
+		out << std::setw(8) << addresses[i].first << std::setw(14) << addresses[i].second << std::setw(8) << share(addresses[i].second) << "%" << std::endl;
+
+	if (per_block.empty())
+		return;
+
+	out << std::endl << "slowest blocks:" << std::endl;
+	std::vector<std::pair<int64_t, block_t>> blocks(per_block.begin(), per_block.end());
+	std::sort(blocks.begin(), blocks.end(), [](const auto& a, const auto& b) { return a.second.time > b.second.time; });
+
+	for (size_t i = 0; i < blocks.size() && i < top; i++)
+	{
+		auto& [start, block] = blocks[i];
+
+		out << std::setw(8) << start << std::setw(14) << block.entries << " entries"
+			<< std::setw(14) << block.time.count() / 1000 << " us" << std::endl;
+	}
+}
+
+inline void IntcodeProfiler::dump(std::ostream& out) const
+{
+	out << "kind,key,count,nanoseconds" << std::endl;
+
+	for (auto [opcode, count] : per_opcode)
+		out << "opcode," << opcode_name(opcode) << "," << count << "," << std::endl;
+
+	for (auto [word, count] : per_word)
+		out << "word," << word << "," << count << "," << std::endl;
+
+	for (auto [address, count] : per_address)
+		out << "address," << address << "," << count << "," << std::endl;
+
+	for (auto& [start, block] : per_block)
+		out << "block," << start << "," << block.entries << "," << block.time.count() << std::endl;
+}
+
+inline std::vector<std::pair<int64_t, uint64_t>> IntcodeWatcher::hot_addresses(size_t top) const
+{
+	std::unordered_map<int64_t, uint64_t> counts;
+
+	for (auto& record : trace_records())
+	{
+		if (record.access != static_cast<uint64_t>(access_t::execute))
+			counts[record.address]++;
+	}
+
+	std::vector<std::pair<int64_t, uint64_t>> hottest(counts.begin(), counts.end());
+	std::sort(hottest.begin(), hottest.end(), [](const auto& a, const auto& b) { return a.second > b.second || (a.second == b.second && a.first < b.first); });
+
+	if (hottest.size() > top)
+		hottest.resize(top);
+
+	return hottest;
+}
+
+inline void IntcodeWatcher::write_trace(const std::string& filepath) const
+{
+	std::ofstream out(filepath, std::ios::binary);
+
+	if (!out)
+		throw std::runtime_error("could not open " + filepath);
+
+	auto records = trace_records();
+	uint64_t count = records.size();
+
+	out.write("ICTR", 4);
+	out.write(reinterpret_cast<const char*>(&trace_interval), sizeof(trace_interval));
+	out.write(reinterpret_cast<const char*>(&traced), sizeof(traced));
+	out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+	out.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(record_t));
+}
+
 using position_t = std::pair<int8_t, int8_t>;
 
 template <typename PositionType>
@@ -0,0 +1,210 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "intcode.hpp"
+
+/**
+	Runs one Intcode program on many independent inputs in lockstep.
+
+	Every lane has its own copy-on-write overlay of the program image. Lanes sitting on the same instruction
+	(same address and same opcode word) form a group, the group decodes the instruction once and executes it
+	for all of its lanes back to back. A group keeps going until its lanes diverge on a jump (or max_burst
+	instructions pass), after which all live lanes are regrouped by instruction pointer, so lanes which took
+	different paths merge again once they reach common code.
+
+	A lane finishes when it halts or asks for more input than it was given.
+*/
+struct IntcodeBatch
+{
+	static constexpr size_t max_burst = 64;
+
+	// lanes run together in chunks of this size, so that the memory of a whole chunk stays in cache
+	static constexpr size_t lane_width = 32;
+
+	struct lane_t
+	{
+		memory_t memory;
+		int64_t instruction_pointer = 0;
+		int64_t relative_base = 0;
+		size_t consumed = 0;
+		bool finished = false;
+	};
+
+	// lane_steps / group_steps is the average number of lanes sharing a decoded instruction
+	uint64_t lane_steps = 0;
+	uint64_t group_steps = 0;
+
+	explicit IntcodeBatch(const std::vector<int64_t>& program) :
+		pristine(program), decoded(pristine.dense_size()), verified_code(find_verified_code(program_hash(program))) {}
+
+	/**
+		Lanes are kept between calls and reset to the pristine image like pooled VMs,
+		so repeated batches of similar size do not allocate lane memory again.
+	*/
+	std::vector<std::vector<int64_t>> run(const std::vector<std::vector<int64_t>>& inputs)
+	{
+		for (auto& lane : lanes)
+		{
+			lane.memory.reset_to(pristine);
+			lane = lane_t{ std::move(lane.memory) };
+		}
+
+		lanes.resize(inputs.size(), lane_t{ pristine });
+
+		std::vector<std::vector<int64_t>> outputs(inputs.size());
+
+		for (size_t first = 0; first < inputs.size(); first += lane_width)
+			run_lanes(first, std::min(first + lane_width, inputs.size()), inputs, outputs);
+
+		return outputs;
+	}
+
+private:
+	void run_lanes(
+		size_t first,
+		size_t last,
+		const std::vector<std::vector<int64_t>>& inputs,
+		std::vector<std::vector<int64_t>>& outputs)
+	{
+		std::vector<size_t> active;
+		for (size_t i = first; i < last; i++)
+			active.push_back(i);
+
+		while (!active.empty())
+		{
+			std::map<std::pair<int64_t, int64_t>, std::vector<size_t>> groups;
+
+			for (auto lane : active)
+			{
+				auto ip = lanes[lane].instruction_pointer;
+				groups[{ ip, lanes[lane].memory.read(ip) }].push_back(lane);
+			}
+
+			active.clear();
+
+			for (auto& [instruction, group] : groups)
+			{
+				run_group(group, inputs, outputs);
+
+				for (auto lane : group)
+				{
+					if (!lanes[lane].finished)
+						active.push_back(lane);
+				}
+			}
+		}
+	}
+
+	/**
+		Like IntcodeVM::decode, only the program image is cached and instructions outside of it are decoded on every fetch.
+	*/
+	const DecodedInstruction& decode(int64_t address, int64_t word)
+	{
+		if (address < 0 || static_cast<size_t>(address) >= decoded.size())
+		{
+			uncached_instruction = IntcodeVM::decode_word(word);
+			return uncached_instruction;
+		}
+
+		auto& entry = decoded[static_cast<size_t>(address)];
+
+		if (!entry.instruction || entry.word != word)
+		{
+			entry = IntcodeVM::decode_word(word);
+			entry.verified = verified_code && verified_code->covers(address, word);
+		}
+
+		return entry;
+	}
+
+	void run_group(
+		std::vector<size_t>& group,
+		const std::vector<std::vector<int64_t>>& inputs,
+		std::vector<std::vector<int64_t>>& outputs)
+	{
+		for (size_t burst = 0; burst < max_burst; burst++)
+		{
+			auto& leader = lanes[group.front()];
+			auto ip = leader.instruction_pointer;
+			auto word = leader.memory.read(ip);
+
+			bool together = std::all_of(group.begin(), group.end(), [&](size_t lane)
+			{
+				return lanes[lane].instruction_pointer == ip && lanes[lane].memory.read(ip) == word;
+			});
+
+			if (!together)
+				return;
+
+			auto& instruction = decode(ip, word);
+			auto& parameters = instruction.parameters;
+
+			group_steps++;
+			lane_steps += group.size();
+
+			for (auto lane_index : group)
+			{
+				auto& lane = lanes[lane_index];
+				auto& memory = lane.memory;
+				auto& rb = lane.relative_base;
+
+				auto src = [&](size_t n)
+				{
+					return parameters[n].get_value(memory.read(ip + 1 + static_cast<int64_t>(n)), memory, rb);
+				};
+
+				auto put = [&](size_t n, int64_t value)
+				{
+					auto argument = memory.read(ip + 1 + static_cast<int64_t>(n));
+
+					memory[instruction.verified ? parameters[n].get_dest_unchecked(argument, rb) : parameters[n].get_dest(argument, rb)] = value;
+				};
+
+				auto& next = lane.instruction_pointer;
+
+				switch (instruction.opcode)
+				{
+				case opcode_t::input:
+					if (lane.consumed == inputs[lane_index].size())
+					{
+						lane.finished = true;
+						break;
+					}
+
+					put(0, inputs[lane_index][lane.consumed++]);
+					next += 2;
+					break;
+
+				case opcode_t::output:
+					outputs[lane_index].push_back(src(0));
+					next += 2;
+					break;
+
+				case opcode_t::halt:
+					next += 1;
+					lane.finished = true;
+					break;
+
+				default:
+					next = execute_instruction(instruction.opcode, ip, rb, src, put);
+					break;
+				}
+			}
+
+			group.erase(std::remove_if(group.begin(), group.end(), [&](size_t lane) { return lanes[lane].finished; }), group.end());
+
+			if (group.empty())
+				return;
+		}
+	}
+
+	memory_t pristine;
+	std::vector<lane_t> lanes;
+
+	decode_cache_t decoded;
+	DecodedInstruction uncached_instruction;
+	std::shared_ptr<const VerifiedCode> verified_code;
+};
@@ -0,0 +1,384 @@
+#pragma once
+
+#include <iostream>
+#include <map>
+#include <set>
+#include <vector>
+
+#include "intcode.hpp"
+
+/**
+	Static control flow analysis of a program image, decoding with the VM's own opcode table.
+
+	Instructions are discovered from address 0 along fall-through edges and jumps with an immediate target.
+	Jumps with an immediate condition are constant: only the side which is always taken is followed.
+	Jumps through memory (function returns) have no static target, so when a program has them,
+	immediate values pushed through a relative destination which decode as an instruction are explored
+	as well, that is how Intcode programs store return addresses.
+
+	Stores with a positional destination write to a known cell, instructions covering such a cell may be
+	self-modified. Stores with a relative destination could go anywhere and are only counted, the engines
+	revalidate what they derived from code at run time anyway.
+*/
+struct ControlFlowGraph
+{
+	struct Block
+	{
+		int64_t start;
+		int64_t end;
+		size_t instructions = 0;
+		std::vector<int64_t> successors;
+
+		// ends with a jump through memory, the successors above are incomplete
+		bool indirect = false;
+		bool halts = false;
+	};
+
+	struct Region
+	{
+		int64_t begin;
+		int64_t end;
+		bool code;
+	};
+
+	std::map<int64_t, Block> blocks;
+
+	std::set<int64_t> instructions;
+	std::set<int64_t> jump_targets;
+	std::set<int64_t> return_sites;
+	std::set<int64_t> constant_jumps;
+	std::set<int64_t> indirect_jumps;
+
+	// cells written by stores with a positional destination
+	std::set<int64_t> written_cells;
+	size_t relative_stores = 0;
+
+	explicit ControlFlowGraph(const std::vector<int64_t>& program) : image(program), code(program.size(), false)
+	{
+		explore({ 0 });
+
+		// code found from a return site can push further return addresses
+		while (!indirect_jumps.empty())
+		{
+			std::vector<int64_t> candidates;
+
+			for (auto site : pushed_constants)
+			{
+				if (!instructions.count(site) && decodes(site))
+				{
+					return_sites.insert(site);
+					candidates.push_back(site);
+				}
+			}
+
+			if (candidates.empty())
+				break;
+
+			explore(candidates);
+		}
+
+		build_blocks();
+	}
+
+	bool is_instruction(int64_t address) const
+	{
+		return instructions.count(address) != 0;
+	}
+
+	bool is_code(int64_t address) const
+	{
+		return address >= 0 && address < size() && code[static_cast<size_t>(address)];
+	}
+
+	/**
+		True for instructions none of whose cells is written by a store with a known address,
+		those can be predecoded, fused or compiled without expecting invalidations.
+	*/
+	bool is_stable(int64_t address) const
+	{
+		if (!is_instruction(address))
+			return false;
+
+		auto end = address + IntcodeVM::instruction_size(image[static_cast<size_t>(address)] % 100);
+
+		return written_cells.lower_bound(address) == written_cells.lower_bound(end);
+	}
+
+	std::vector<int64_t> self_modified_instructions() const
+	{
+		std::vector<int64_t> modified;
+
+		for (auto address : instructions)
+		{
+			if (!is_stable(address))
+				modified.push_back(address);
+		}
+
+		return modified;
+	}
+
+	// maximal runs of code and data cells covering the whole image
+	std::vector<Region> regions() const
+	{
+		std::vector<Region> runs;
+
+		for (int64_t address = 0; address < size(); address++)
+		{
+			bool is_code_cell = code[static_cast<size_t>(address)];
+
+			if (runs.empty() || runs.back().code != is_code_cell)
+				runs.push_back({ address, address, is_code_cell });
+
+			runs.back().end = address + 1;
+		}
+
+		return runs;
+	}
+
+	const Block* block_at(int64_t address) const
+	{
+		auto block = blocks.upper_bound(address);
+
+		if (block == blocks.begin())
+			return nullptr;
+
+		--block;
+
+		return address < block->second.end ? &block->second : nullptr;
+	}
+
+	void print(std::ostream& out) const
+	{
+		for (auto& [start, block] : blocks)
+		{
+			out << "[" << start << ", " << block.end << ") " << block.instructions << " instructions";
+
+			if (return_sites.count(start))
+				out << ", return site";
+
+			if (block.halts)
+				out << ", halts";
+
+			if (!block.successors.empty())
+			{
+				out << " ->";
+
+				for (auto successor : block.successors)
+					out << " " << successor;
+			}
+
+			if (block.indirect)
+				out << " -> ?";
+
+			out << std::endl;
+		}
+
+		size_t code_cells = std::count(code.begin(), code.end(), true);
+
+		out << std::endl;
+		out << blocks.size() << " blocks, " << instructions.size() << " instructions, "
+			<< (blocks.empty() ? 0.0 : static_cast<double>(instructions.size()) / blocks.size()) << " per block" << std::endl;
+		out << code_cells << " code cells, " << size() - static_cast<int64_t>(code_cells) << " data cells" << std::endl;
+		out << jump_targets.size() << " jump targets, " << return_sites.size() << " return sites, "
+			<< constant_jumps.size() << " constant jumps, " << indirect_jumps.size() << " indirect jumps" << std::endl;
+		out << written_cells.size() << " cells written by known stores, " << relative_stores << " relative stores, "
+			<< self_modified_instructions().size() << " possibly self-modified instructions" << std::endl;
+	}
+
+private:
+	int64_t size() const
+	{
+		return static_cast<int64_t>(image.size());
+	}
+
+	bool decodes(int64_t address) const
+	{
+		if (address < 0 || address >= size())
+			return false;
+
+		auto word = image[static_cast<size_t>(address)];
+		auto instruction_size = IntcodeVM::instruction_size(word % 100);
+
+		if (!instruction_size || address + instruction_size > size())
+			return false;
+
+		auto modes = word / 100;
+		for (int64_t i = 1; i < instruction_size; i++, modes /= 10)
+		{
+			if (modes % 10 > static_cast<int64_t>(mode_t::relative))
+				return false;
+		}
+
+		return true;
+	}
+
+	int64_t argument(int64_t address, int64_t n) const
+	{
+		return image[static_cast<size_t>(address + 1 + n)];
+	}
+
+	void note_store(int64_t address, const DecodedInstruction& decoded, size_t destination)
+	{
+		auto mode = decoded.parameters[destination].m_mode;
+
+		if (mode == mode_t::positional)
+			written_cells.insert(argument(address, static_cast<int64_t>(destination)));
+
+		if (mode != mode_t::relative)
+			return;
+
+		relative_stores++;
+
+		for (size_t i = 0; i < destination; i++)
+		{
+			if (decoded.parameters[i].m_mode == mode_t::immediate)
+				pushed_constants.insert(argument(address, static_cast<int64_t>(i)));
+		}
+	}
+
+	void explore(std::vector<int64_t> frontier)
+	{
+		while (!frontier.empty())
+		{
+			auto address = frontier.back();
+			frontier.pop_back();
+
+			while (decodes(address) && !instructions.count(address))
+			{
+				auto decoded = IntcodeVM::decode_word(image[static_cast<size_t>(address)]);
+				auto next = address + IntcodeVM::instruction_size(static_cast<int64_t>(decoded.opcode));
+
+				instructions.insert(address);
+				std::fill(code.begin() + address, code.begin() + next, true);
+
+				switch (decoded.opcode)
+				{
+				case opcode_t::add:
+				case opcode_t::multiply:
+				case opcode_t::less_than:
+				case opcode_t::equals:
+					note_store(address, decoded, 2);
+					break;
+
+				case opcode_t::input:
+					note_store(address, decoded, 0);
+					break;
+
+				case opcode_t::jump_if_true:
+				case opcode_t::jump_if_false:
+				{
+					bool may_jump = true;
+					bool may_fall_through = true;
+
+					if (decoded.parameters[0].m_mode == mode_t::immediate)
+					{
+						auto condition = argument(address, 0);
+						bool taken = decoded.opcode == opcode_t::jump_if_true ? condition > 0 : condition == 0;
+
+						constant_jumps.insert(address);
+						may_jump = taken;
+						may_fall_through = !taken;
+					}
+
+					if (may_jump && decoded.parameters[1].m_mode == mode_t::immediate)
+					{
+						jump_targets.insert(argument(address, 1));
+						frontier.push_back(argument(address, 1));
+					}
+					else if (may_jump)
+					{
+						indirect_jumps.insert(address);
+					}
+
+					if (!may_fall_through)
+						next = -1;
+
+					break;
+				}
+
+				case opcode_t::halt:
+					next = -1;
+					break;
+
+				default:
+					break;
+				}
+
+				address = next;
+			}
+		}
+	}
+
+	void build_blocks()
+	{
+		std::set<int64_t> leaders = jump_targets;
+		leaders.insert(return_sites.begin(), return_sites.end());
+
+		if (!instructions.empty())
+			leaders.insert(*instructions.begin());
+
+		for (auto address : instructions)
+		{
+			auto opcode = static_cast<opcode_t>(image[static_cast<size_t>(address)] % 100);
+
+			if (opcode == opcode_t::jump_if_true || opcode == opcode_t::jump_if_false || opcode == opcode_t::halt)
+				leaders.insert(address + IntcodeVM::instruction_size(static_cast<int64_t>(opcode)));
+		}
+
+		Block* current = nullptr;
+
+		for (auto address : instructions)
+		{
+			auto word = image[static_cast<size_t>(address)];
+			auto decoded = IntcodeVM::decode_word(word);
+			auto next = address + IntcodeVM::instruction_size(word % 100);
+
+			if (!current || leaders.count(address) || current->end != address)
+			{
+				if (current && current->end == address)
+					current->successors.push_back(address);
+
+				current = &blocks[address];
+				current->start = address;
+			}
+
+			current->end = next;
+			current->instructions++;
+
+			switch (decoded.opcode)
+			{
+			case opcode_t::jump_if_true:
+			case opcode_t::jump_if_false:
+			{
+				auto condition = argument(address, 0);
+				bool constant = constant_jumps.count(address) != 0;
+				bool always_taken = constant && (decoded.opcode == opcode_t::jump_if_true ? condition > 0 : condition == 0);
+
+				if (indirect_jumps.count(address))
+					current->indirect = true;
+
+				else if (!constant || always_taken)
+					current->successors.push_back(argument(address, 1));
+
+				if (!always_taken && instructions.count(next))
+					current->successors.push_back(next);
+
+				current = nullptr;
+				break;
+			}
+
+			case opcode_t::halt:
+				current->halts = true;
+				current = nullptr;
+				break;
+
+			default:
+				break;
+			}
+		}
+	}
+
+	std::vector<int64_t> image;
+	std::vector<bool> code;
+	std::set<int64_t> pushed_constants;
+};
@@ -0,0 +1,304 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "intcode.hpp"
+#include "intcode_image.hpp"
+
+/**
+	Checkpoint files: an append-only sequence of records, each holding the registers, the values waiting
+	in the VM's channels and memory pages.
+
+		char     magic[4]               "ICCP"
+		uint32_t flags                  full_record: memory is complete, otherwise only the pages changed since the previous record
+		uint64_t image_hash
+		int64_t  instruction_pointer
+		int64_t  relative_base
+		uint64_t dense_size             cells in the program image part of memory
+		uint64_t dense_words            full records store the dense pages contiguously, 0 otherwise
+		uint64_t page_count             page records: the page index followed by page_size words
+		uint64_t input_count
+		uint64_t output_count
+		uint64_t checksum               program_hash of the header fields above and everything after the header
+		dense words, page records, pending inputs, pending outputs
+
+	Everything is a multiple of 8 bytes, so words are read from the mapped file in place.
+	A record cut short by a crash fails its checksum and is ignored together with everything after it.
+	Counts are checked against the bytes left in the file before the checksum is computed, and full records
+	must store exactly the dense pages dense_size calls for.
+*/
+namespace checkpoint {
+
+	constexpr char magic[4] = { 'I', 'C', 'C', 'P' };
+	constexpr uint32_t full_record = 1;
+
+	struct header_t
+	{
+		char magic[4];
+		uint32_t flags;
+		uint64_t image_hash;
+		int64_t instruction_pointer;
+		int64_t relative_base;
+		uint64_t dense_size;
+		uint64_t dense_words;
+		uint64_t page_count;
+		uint64_t input_count;
+		uint64_t output_count;
+		uint64_t checksum;
+	};
+
+	static_assert(sizeof(header_t) % sizeof(int64_t) == 0, "records must keep words 8 byte aligned");
+	static_assert(offsetof(header_t, checksum) + sizeof(uint64_t) == sizeof(header_t), "the checksum must be the last header field");
+
+	inline uint64_t checksum(const header_t& header, const int64_t* payload, size_t payload_words)
+	{
+		int64_t fields[offsetof(header_t, checksum) / sizeof(int64_t)];
+		std::memcpy(fields, &header, sizeof(fields));
+
+		return program_hash(payload, payload_words, program_hash(fields, std::size(fields)));
+	}
+
+	inline uint64_t dense_words(uint64_t dense_size)
+	{
+		return (dense_size + memory_t::page_size - 1) / memory_t::page_size * memory_t::page_size;
+	}
+
+	inline std::vector<int64_t> pending_values(IntcodeChannel channel)
+	{
+		std::vector<int64_t> values;
+
+		while (!channel.empty())
+			values.push_back(channel.pop());
+
+		return values;
+	}
+}
+
+/**
+	Appends checkpoints of a VM to a file. The first record is full, the following ones only hold
+	the pages written since the previous record: the writer keeps a copy of the memory it saved last,
+	which shares its pages with the VM, so pages the VM wrote since are the ones it no longer shares.
+	That costs one page copy on the first write to each page after a checkpoint.
+*/
+class IntcodeCheckpointWriter
+{
+public:
+	explicit IntcodeCheckpointWriter(const std::string& filepath) :
+		out(filepath, std::ios::binary | std::ios::trunc)
+	{
+		if (!out)
+			throw std::runtime_error("could not open " + filepath);
+	}
+
+	/**
+		Continues a checkpoint file the VM was restored from, the next record is incremental.
+		The file is cut back to intact_size first (see restore_checkpoint), records appended behind
+		a torn one would never be read again.
+	*/
+	IntcodeCheckpointWriter(const std::string& filepath, const IntcodeVM& restored, uint64_t intact_size) :
+		out(truncated(filepath, intact_size), std::ios::binary | std::ios::app), last_saved(restored.memory), last_image_hash(restored.image_hash)
+	{
+		if (!out)
+			throw std::runtime_error("could not open " + filepath);
+	}
+
+	// returns the number of pages written
+	size_t write(const IntcodeVM& vm)
+	{
+		bool full = !last_saved || last_image_hash != vm.image_hash || last_saved->dense_size() != vm.memory.dense_size();
+
+		auto& memory = vm.memory;
+		std::vector<int64_t> payload;
+		std::vector<int64_t> pages;
+
+		size_t dense_pages = (memory.dense_size() + memory_t::page_size - 1) / memory_t::page_size;
+
+		if (full)
+		{
+			memory.for_each_page([&](int64_t index, const memory_t::page_t& page)
+			{
+				if (static_cast<size_t>(index) < dense_pages)
+					payload.insert(payload.end(), page.begin(), page.end());
+				else
+					pages.push_back(index);
+			});
+		}
+		else
+		{
+			pages = memory.pages_changed_since(*last_saved);
+		}
+
+		size_t dense_words = payload.size();
+
+		for (auto index : pages)
+		{
+			payload.push_back(index);
+
+			auto page = memory.find_page(index);
+			if (page)
+				payload.insert(payload.end(), page->begin(), page->end());
+			else
+				payload.insert(payload.end(), memory_t::page_size, 0);
+		}
+
+		auto inputs = checkpoint::pending_values(vm.input_channel);
+		auto outputs = checkpoint::pending_values(vm.output_channel);
+
+		payload.insert(payload.end(), inputs.begin(), inputs.end());
+		payload.insert(payload.end(), outputs.begin(), outputs.end());
+
+		checkpoint::header_t header{
+			{ checkpoint::magic[0], checkpoint::magic[1], checkpoint::magic[2], checkpoint::magic[3] },
+			full ? checkpoint::full_record : 0,
+			vm.image_hash,
+			vm.instruction_pointer,
+			vm.relative_base,
+			memory.dense_size(),
+			dense_words,
+			pages.size(),
+			inputs.size(),
+			outputs.size(),
+			0
+		};
+
+		header.checksum = checkpoint::checksum(header, payload.data(), payload.size());
+
+		out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		out.write(reinterpret_cast<const char*>(payload.data()), payload.size() * sizeof(int64_t));
+		out.flush();
+
+		if (!out)
+			throw std::runtime_error("could not write checkpoint");
+
+		last_saved = memory;
+		last_image_hash = vm.image_hash;
+
+		return (full ? dense_pages : 0) + pages.size();
+	}
+
+private:
+	static const std::string& truncated(const std::string& filepath, uint64_t size)
+	{
+		std::filesystem::resize_file(filepath, size);
+
+		return filepath;
+	}
+
+	std::ofstream out;
+	std::optional<memory_t> last_saved;
+	uint64_t last_image_hash = 0;
+};
+
+/**
+	VM in the state of the last intact record of a checkpoint file, with its pending inputs and outputs
+	back in its channels. Records are replayed in order, each full one starts over, and page contents
+	are copied straight from the mapping.
+
+	intact_size receives the offset where the last intact record ends, anything behind it is a torn write.
+*/
+inline IntcodeVM restore_checkpoint(const std::string& filepath, uint64_t* intact_size = nullptr)
+{
+	MappedFile file(filepath);
+
+	auto bytes = file.data();
+	auto end = bytes + file.size();
+
+	std::optional<IntcodeVM> vm;
+
+	while (static_cast<size_t>(end - bytes) >= sizeof(checkpoint::header_t))
+	{
+		checkpoint::header_t header;
+		std::memcpy(&header, bytes, sizeof(header));
+
+		if (std::memcmp(header.magic, checkpoint::magic, sizeof(checkpoint::magic)) != 0)
+			break;
+
+		auto words = reinterpret_cast<const int64_t*>(bytes + sizeof(header));
+		auto available = static_cast<uint64_t>(end - bytes - sizeof(header)) / sizeof(int64_t);
+
+		// takes count blocks of size words out of what is left of the file, false if they do not fit
+		auto remaining = available;
+		auto fits = [&](uint64_t count, uint64_t size)
+		{
+			if (count > remaining / size)
+				return false;
+
+			remaining -= count * size;
+			return true;
+		};
+
+		if (!fits(header.dense_words, 1) || !fits(header.page_count, memory_t::page_size + 1) || !fits(header.input_count, 1) || !fits(header.output_count, 1))
+			break;
+
+		auto payload_words = static_cast<size_t>(available - remaining);
+
+		if (checkpoint::checksum(header, words, payload_words) != header.checksum)
+			break;
+
+		bool full = header.flags & checkpoint::full_record;
+
+		if (header.dense_words != (full ? checkpoint::dense_words(header.dense_size) : 0))
+			throw std::runtime_error("checkpoint record does not hold its dense pages in " + filepath);
+
+		if (!full && (!vm || vm->image_hash != header.image_hash || vm->memory.dense_size() != header.dense_size))
+			throw std::runtime_error("incremental checkpoint does not continue the previous one in " + filepath);
+
+		if (full)
+		{
+			memory_t memory(words, static_cast<size_t>(header.dense_size));
+
+			// the last dense page can hold cells written past the image
+			if (header.dense_size % memory_t::page_size)
+			{
+				auto last = static_cast<int64_t>(header.dense_size / memory_t::page_size);
+				memory.load_page(last, words + last * memory_t::page_size);
+			}
+
+			vm.emplace(IntcodeSnapshot{ memory, header.instruction_pointer, header.relative_base, header.image_hash });
+		}
+		else
+		{
+			vm->instruction_pointer = header.instruction_pointer;
+			vm->relative_base = header.relative_base;
+		}
+
+		// the writer saves channels, which cannot hold more than their capacity
+		if (header.input_count > vm->input_channel.capacity() || header.output_count > vm->output_channel.capacity())
+			throw std::runtime_error("checkpoint holds more pending values than a channel in " + filepath);
+
+		auto record = words + header.dense_words;
+
+		for (uint64_t i = 0; i < header.page_count; i++, record += memory_t::page_size + 1)
+			vm->memory.load_page(record[0], record + 1);
+
+		vm->input_channel.clear();
+		vm->output_channel.clear();
+
+		vm->input_channel.write(record, record + header.input_count);
+		record += header.input_count;
+
+		vm->output_channel.write(record, record + header.output_count);
+		record += header.output_count;
+
+		bytes = reinterpret_cast<const uint8_t*>(record);
+	}
+
+	if (!vm)
+		throw std::runtime_error("no intact checkpoint in " + filepath);
+
+	if (intact_size)
+		*intact_size = static_cast<uint64_t>(bytes - file.data());
+
+	// code derived from the loaded pages is rebuilt on demand
+	vm->restore(vm->snapshot());
+
+	return std::move(*vm);
+}
@@ -0,0 +1,192 @@
+#pragma once
+
+#include <array>
+#include <stdexcept>
+
+#include "intcode.hpp"
+
+/**
+	Intcode interpreter usable in constant expressions, for small fixed programs with fixed inputs.
+	Memory is a std::array of MemorySize cells which the program can not grow beyond.
+
+	Opcodes, parameter modes and execution states are the ones of intcode.hpp, and apart from input, output
+	and halt the opcodes run through the same execute_instruction as the other engines.
+	Writing through an immediate parameter is an error here too.
+
+	Every error, including running past the step budget, throws. During constant evaluation a throw
+	is not a constant expression, so a program which does not fit is rejected at compile time.
+*/
+template <size_t MemorySize, size_t MaxOutputs>
+struct ConstexprVM
+{
+	std::array<int64_t, MemorySize> memory{};
+	std::array<int64_t, MaxOutputs> outputs{};
+	size_t output_count = 0;
+
+	int64_t instruction_pointer = 0;
+	int64_t relative_base = 0;
+	size_t steps = 0;
+	execution_state_t state = execution_state_t::normal;
+
+	constexpr int64_t& cell(int64_t address)
+	{
+		if (address < 0 || static_cast<size_t>(address) >= MemorySize)
+			throw std::out_of_range("address outside of the constexpr VM memory");
+
+		return memory[static_cast<size_t>(address)];
+	}
+
+	constexpr mode_t mode(size_t n)
+	{
+		auto modes = cell(instruction_pointer) / 100;
+
+		for (size_t i = 0; i < n; i++)
+			modes /= 10;
+
+		return static_cast<mode_t>(modes % 10);
+	}
+
+	constexpr int64_t value(size_t n)
+	{
+		auto argument = cell(instruction_pointer + 1 + static_cast<int64_t>(n));
+
+		switch (mode(n))
+		{
+		case mode_t::positional:	return cell(argument);
+		case mode_t::immediate:		return argument;
+		case mode_t::relative:		return cell(relative_base + argument);
+		default:					throw std::runtime_error("invalid parameter mode");
+		}
+	}
+
+	constexpr int64_t& dest(size_t n)
+	{
+		auto argument = cell(instruction_pointer + 1 + static_cast<int64_t>(n));
+
+		switch (mode(n))
+		{
+		case mode_t::positional:	return cell(argument);
+		case mode_t::relative:		return cell(relative_base + argument);
+		default:					throw std::runtime_error("invalid mode for destination parameter");
+		}
+	}
+
+	/**
+		Runs until the program halts (halted) or wants more input than given (requested_value).
+	*/
+	template <size_t InputCount>
+	constexpr void run(const std::array<int64_t, InputCount>& inputs, size_t step_budget)
+	{
+		size_t consumed = 0;
+		auto& ip = instruction_pointer;
+
+		while (state == execution_state_t::normal)
+		{
+			if (steps++ == step_budget)
+				throw std::runtime_error("program exceeded its step budget");
+
+			auto opcode = static_cast<opcode_t>(cell(ip) % 100);
+
+			switch (opcode)
+			{
+			case opcode_t::input:
+				if (consumed == InputCount)
+				{
+					state = execution_state_t::requested_value;
+					break;
+				}
+
+				dest(0) = inputs[consumed++];
+				ip += 2;
+				break;
+
+			case opcode_t::output:
+				if (output_count == MaxOutputs)
+					throw std::runtime_error("program produced more outputs than MaxOutputs");
+
+				outputs[output_count++] = value(0);
+				ip += 2;
+				break;
+
+			case opcode_t::halt:
+				ip += 1;
+				state = execution_state_t::halted;
+				break;
+
+			default:
+				ip = execute_instruction(
+					opcode, ip, relative_base,
+					[this](size_t n) { return value(n); },
+					[this](size_t n, int64_t result) { dest(n) = result; });
+				break;
+			}
+		}
+	}
+};
+
+constexpr size_t default_step_budget = 10000;
+
+template <typename... Words>
+constexpr std::array<int64_t, sizeof...(Words)> intcode_program(Words... words)
+{
+	return { static_cast<int64_t>(words)... };
+}
+
+/**
+	The program padded with zeroed cells, for programs which use memory past their image.
+*/
+template <size_t MemorySize, size_t ProgramSize>
+constexpr std::array<int64_t, MemorySize> with_memory(const std::array<int64_t, ProgramSize>& program)
+{
+	static_assert(MemorySize >= ProgramSize, "memory must hold the whole program");
+
+	std::array<int64_t, MemorySize> memory{};
+
+	for (size_t i = 0; i < ProgramSize; i++)
+		memory[i] = program[i];
+
+	return memory;
+}
+
+template <size_t StepBudget = default_step_budget, size_t MaxOutputs = 16, size_t MemorySize, size_t InputCount>
+constexpr ConstexprVM<MemorySize, MaxOutputs> run_constexpr(
+	const std::array<int64_t, MemorySize>& program,
+	const std::array<int64_t, InputCount>& inputs)
+{
+	ConstexprVM<MemorySize, MaxOutputs> vm;
+
+	vm.memory = program;
+	vm.run(inputs, StepBudget);
+
+	return vm;
+}
+
+template <size_t StepBudget = default_step_budget, size_t MaxOutputs = 16, size_t MemorySize>
+constexpr ConstexprVM<MemorySize, MaxOutputs> run_constexpr(const std::array<int64_t, MemorySize>& program)
+{
+	return run_constexpr<StepBudget, MaxOutputs>(program, std::array<int64_t, 0>{});
+}
+
+// examples from the puzzle descriptions, evaluated while compiling
+
+// day 2
+static_assert(run_constexpr(intcode_program(1, 9, 10, 3, 2, 3, 11, 0, 99, 30, 40, 50)).memory[0] == 3500);
+static_assert(run_constexpr(intcode_program(1, 1, 1, 4, 99, 5, 6, 0, 99)).memory[0] == 30);
+
+// day 5
+constexpr auto is_eight = intcode_program(3, 9, 8, 9, 10, 9, 4, 9, 99, -1, 8);
+static_assert(run_constexpr(is_eight, intcode_program(8)).outputs[0] == 1);
+static_assert(run_constexpr(is_eight, intcode_program(7)).outputs[0] == 0);
+
+constexpr auto compare_to_eight = intcode_program(
+	3, 21, 1008, 21, 8, 20, 1005, 20, 22, 107, 8, 21, 20, 1006, 20, 31, 1106, 0, 36, 98, 0, 0, 1002, 21, 125, 20, 4, 20,
+	1105, 1, 46, 104, 999, 1105, 1, 46, 1101, 1000, 1, 20, 4, 20, 1105, 1, 46, 98, 99);
+static_assert(run_constexpr(compare_to_eight, intcode_program(7)).outputs[0] == 999);
+static_assert(run_constexpr(compare_to_eight, intcode_program(8)).outputs[0] == 1000);
+static_assert(run_constexpr(compare_to_eight, intcode_program(9)).outputs[0] == 1001);
+
+// day 9
+constexpr auto quine = intcode_program(109, 1, 204, -1, 1001, 100, 1, 100, 1008, 100, 16, 101, 1006, 101, 0, 99);
+constexpr auto quine_run = run_constexpr(with_memory<128>(quine));
+static_assert(quine_run.output_count == quine.size() && quine_run.outputs[15] == 99);
+static_assert(run_constexpr(intcode_program(104, 1125899906842624, 99)).outputs[0] == 1125899906842624);
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <exception>
+#include <experimental/coroutine>
+
+#include "intcode.hpp"
+
+/**
+	A VM running as a coroutine: input instructions co_await a value from the host and outputs co_yield one.
+	The frame is allocated once when the coroutine starts, passing values in and out only suspends and resumes it.
+
+	The host drives it with resume() and send(), between those calls it can look at the suspension reason:
+	wants_input(), an output(), interrupted() or done().
+*/
+struct IntcodeCoroutine
+{
+	struct input_t {};
+	struct interrupt_t {};
+
+	struct promise_type
+	{
+		int64_t value = 0;
+		bool wants_input = false;
+		bool interrupted = false;
+		std::exception_ptr failure;
+
+		IntcodeCoroutine get_return_object()
+		{
+			return IntcodeCoroutine(handle_t::from_promise(*this));
+		}
+
+		std::experimental::suspend_always initial_suspend() noexcept { return {}; }
+		std::experimental::suspend_always final_suspend() noexcept { return {}; }
+
+		std::experimental::suspend_always yield_value(int64_t output) noexcept
+		{
+			value = output;
+			return {};
+		}
+
+		auto await_transform(input_t) noexcept
+		{
+			struct awaiter
+			{
+				promise_type& promise;
+
+				bool await_ready() const noexcept { return false; }
+				void await_suspend(std::experimental::coroutine_handle<>) noexcept { promise.wants_input = true; }
+
+				int64_t await_resume() noexcept
+				{
+					promise.wants_input = false;
+					return promise.value;
+				}
+			};
+
+			return awaiter{ *this };
+		}
+
+		auto await_transform(interrupt_t) noexcept
+		{
+			struct awaiter
+			{
+				promise_type& promise;
+
+				bool await_ready() const noexcept { return false; }
+				void await_suspend(std::experimental::coroutine_handle<>) noexcept { promise.interrupted = true; }
+				void await_resume() noexcept { promise.interrupted = false; }
+			};
+
+			return awaiter{ *this };
+		}
+
+		void return_void() noexcept {}
+		void unhandled_exception() noexcept { failure = std::current_exception(); }
+	};
+
+	using handle_t = std::experimental::coroutine_handle<promise_type>;
+
+	IntcodeCoroutine(IntcodeCoroutine&& other) noexcept : handle(other.handle)
+	{
+		other.handle = nullptr;
+	}
+
+	IntcodeCoroutine& operator=(IntcodeCoroutine&& other) noexcept
+	{
+		std::swap(handle, other.handle);
+		return *this;
+	}
+
+	IntcodeCoroutine(const IntcodeCoroutine&) = delete;
+	IntcodeCoroutine& operator=(const IntcodeCoroutine&) = delete;
+
+	~IntcodeCoroutine()
+	{
+		if (handle)
+			handle.destroy();
+	}
+
+	bool done() const { return handle.done(); }
+	bool wants_input() const { return !done() && handle.promise().wants_input; }
+
+	// the VM reached one of its limits (vm.interrupt_reason tells which), resume() continues where it stopped
+	bool interrupted() const { return !done() && handle.promise().interrupted; }
+
+	// the last value the VM provided
+	int64_t output() const { return handle.promise().value; }
+
+	execution_state_t state() const
+	{
+		if (done())
+			return execution_state_t::halted;
+
+		if (interrupted())
+			return execution_state_t::interrupted;
+
+		return wants_input() ? execution_state_t::requested_value : execution_state_t::provided_value;
+	}
+
+	/**
+		Runs until the next output, input, interrupt or halt.
+	*/
+	execution_state_t resume()
+	{
+		handle.resume();
+
+		if (auto failure = handle.promise().failure)
+			std::rethrow_exception(failure);
+
+		return state();
+	}
+
+	execution_state_t send(int64_t input)
+	{
+		if (!wants_input())
+			throw std::runtime_error("the VM is not waiting for input");
+
+		handle.promise().value = input;
+
+		return resume();
+	}
+
+private:
+	explicit IntcodeCoroutine(handle_t handle) : handle(handle) {}
+
+	handle_t handle;
+};
+
+/**
+	The VM runs on whatever engine it is set to and must outlive the coroutine.
+	Nothing runs before the first resume().
+*/
+inline IntcodeCoroutine run_as_coroutine(IntcodeVM& vm)
+{
+	int64_t output = 0;
+	int64_t input = 0;
+	bool has_input = false;
+
+	while (true)
+	{
+		switch (vm.run(output, input, !has_input))
+		{
+		case execution_state_t::requested_value:
+			input = co_await IntcodeCoroutine::input_t{};
+			has_input = true;
+			break;
+
+		case execution_state_t::consumed_value:
+			has_input = false;
+			break;
+
+		case execution_state_t::provided_value:
+			co_yield output;
+			break;
+
+		case execution_state_t::interrupted:
+			co_await IntcodeCoroutine::interrupt_t{};
+			break;
+
+		default:
+			co_return;
+		}
+	}
+}
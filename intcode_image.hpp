@@ -0,0 +1,344 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/**
+	64-bit FNV-1a over the program words, identifies a program image independently of where it was loaded from.
+*/
+inline uint64_t program_hash(const int64_t* words, size_t count, uint64_t hash = 14695981039346656037ull)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		auto word = static_cast<uint64_t>(words[i]);
+
+		for (size_t byte = 0; byte < sizeof(word); byte++, word >>= 8)
+		{
+			hash ^= word & 0xff;
+			hash *= 1099511628211ull;
+		}
+	}
+
+	return hash;
+}
+
+inline uint64_t program_hash(const std::vector<int64_t>& program)
+{
+	return program_hash(program.data(), program.size());
+}
+
+/**
+	Read only view of a whole file, mapped into memory by a single call.
+*/
+class MappedFile
+{
+public:
+	explicit MappedFile(const std::string& filepath)
+	{
+#ifdef _WIN32
+		file = CreateFileA(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+		if (file == INVALID_HANDLE_VALUE)
+			throw std::runtime_error("could not open " + filepath);
+
+		LARGE_INTEGER file_size;
+		GetFileSizeEx(file, &file_size);
+		length = static_cast<size_t>(file_size.QuadPart);
+
+		if (length)
+		{
+			mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+			if (mapping)
+				bytes = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+		}
+#else
+		descriptor = open(filepath.c_str(), O_RDONLY);
+
+		if (descriptor < 0)
+			throw std::runtime_error("could not open " + filepath);
+
+		struct stat status;
+		fstat(descriptor, &status);
+		length = static_cast<size_t>(status.st_size);
+
+		if (length)
+		{
+			auto view = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+
+			if (view != MAP_FAILED)
+				bytes = static_cast<const uint8_t*>(view);
+		}
+#endif
+
+		if (length && !bytes)
+		{
+			close_handles();
+			throw std::runtime_error("could not map " + filepath);
+		}
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	~MappedFile()
+	{
+		close_handles();
+	}
+
+	const uint8_t* data() const { return bytes; }
+	size_t size() const { return length; }
+
+private:
+	void close_handles()
+	{
+#ifdef _WIN32
+		if (bytes)
+			UnmapViewOfFile(bytes);
+
+		if (mapping)
+			CloseHandle(mapping);
+
+		if (file != INVALID_HANDLE_VALUE)
+			CloseHandle(file);
+#else
+		if (bytes)
+			munmap(const_cast<uint8_t*>(bytes), length);
+
+		if (descriptor >= 0)
+			close(descriptor);
+#endif
+	}
+
+	const uint8_t* bytes = nullptr;
+	size_t length = 0;
+
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = nullptr;
+#else
+	int descriptor = -1;
+#endif
+};
+
+/**
+	Binary program images:
+
+		char     magic[4]    "ICIM"
+		uint32_t flags       varint_words: the words are zigzag LEB128 varints instead of raw int64
+		uint64_t count       number of words
+		uint64_t hash        program_hash of the words
+		words
+
+	Everything is little-endian (like every host this runs on), raw words start at offset 24
+	so a mapped image is used in place without decoding.
+*/
+namespace program_image {
+
+	constexpr char magic[4] = { 'I', 'C', 'I', 'M' };
+	constexpr uint32_t varint_words = 1;
+
+	struct header_t
+	{
+		char magic[4];
+		uint32_t flags;
+		uint64_t count;
+		uint64_t hash;
+	};
+
+	static_assert(sizeof(header_t) == 24, "raw words must stay 8 byte aligned");
+
+	inline bool is_image(const uint8_t* bytes, size_t size)
+	{
+		return size >= sizeof(header_t) && std::memcmp(bytes, magic, sizeof(magic)) == 0;
+	}
+
+	inline void write_varint(std::vector<uint8_t>& out, int64_t word)
+	{
+		auto zigzag = (static_cast<uint64_t>(word) << 1) ^ static_cast<uint64_t>(word >> 63);
+
+		while (zigzag >= 0x80)
+		{
+			out.push_back(static_cast<uint8_t>(zigzag | 0x80));
+			zigzag >>= 7;
+		}
+
+		out.push_back(static_cast<uint8_t>(zigzag));
+	}
+
+	inline const uint8_t* read_varint(const uint8_t* in, const uint8_t* end, int64_t& word)
+	{
+		uint64_t zigzag = 0;
+
+		for (int shift = 0; in != end && shift < 64; shift += 7)
+		{
+			auto byte = *in++;
+			zigzag |= static_cast<uint64_t>(byte & 0x7f) << shift;
+
+			if (!(byte & 0x80))
+			{
+				word = static_cast<int64_t>(zigzag >> 1) ^ -static_cast<int64_t>(zigzag & 1);
+				return in;
+			}
+		}
+
+		throw std::runtime_error("truncated varint in program image");
+	}
+
+	/**
+		Comma separated words as in the puzzle inputs, parsed straight from the mapped text.
+	*/
+	inline std::vector<int64_t> parse_text(const uint8_t* in, const uint8_t* end)
+	{
+		std::vector<int64_t> words;
+
+		while (in != end)
+		{
+			bool negative = *in == '-';
+			auto digits = negative ? in + 1 : in;
+
+			if (digits == end || *digits < '0' || *digits > '9')
+			{
+				in++;
+				continue;
+			}
+
+			int64_t word = 0;
+			for (in = digits; in != end && *in >= '0' && *in <= '9'; in++)
+				word = word * 10 + (*in - '0');
+
+			words.push_back(negative ? -word : word);
+		}
+
+		return words;
+	}
+
+	inline void write(const std::string& filepath, const std::vector<int64_t>& program, bool varint = false)
+	{
+		header_t header{ { magic[0], magic[1], magic[2], magic[3] }, varint ? varint_words : 0, program.size(), program_hash(program) };
+
+		std::ofstream out(filepath, std::ios::binary);
+
+		if (!out)
+			throw std::runtime_error("could not open " + filepath);
+
+		out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+		if (!varint)
+		{
+			out.write(reinterpret_cast<const char*>(program.data()), program.size() * sizeof(int64_t));
+			return;
+		}
+
+		std::vector<uint8_t> encoded;
+		for (auto word : program)
+			write_varint(encoded, word);
+
+		out.write(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+	}
+}
+
+/**
+	A loaded program, either a binary image or the text format (told apart by the magic).
+	Raw images are read straight from the mapping, varint images and text are decoded once.
+
+	The hash of a binary image is checked against its words on load: it is the key compiled programs
+	and verified code are looked up by, a stale or corrupt image must not pick up another program's.
+*/
+class ProgramImage
+{
+public:
+	explicit ProgramImage(const std::string& filepath) : mapping(std::make_unique<MappedFile>(filepath))
+	{
+		auto bytes = mapping->data();
+		auto end = bytes + mapping->size();
+
+		if (!program_image::is_image(bytes, mapping->size()))
+		{
+			decoded = program_image::parse_text(bytes, end);
+			use_decoded(program_hash(decoded));
+			return;
+		}
+
+		program_image::header_t header;
+		std::memcpy(&header, bytes, sizeof(header));
+		bytes += sizeof(header);
+
+		if (header.flags & program_image::varint_words)
+		{
+			// every word takes at least a byte, a larger count would only allocate for a truncated file
+			if (static_cast<uint64_t>(end - bytes) < header.count)
+				throw std::runtime_error("truncated program image " + filepath);
+
+			decoded.resize(static_cast<size_t>(header.count));
+
+			for (auto& word : decoded)
+				bytes = program_image::read_varint(bytes, end, word);
+
+			use_decoded(header.hash);
+		}
+		else
+		{
+			if (static_cast<size_t>(end - bytes) / sizeof(int64_t) < header.count)
+				throw std::runtime_error("truncated program image " + filepath);
+
+			first = reinterpret_cast<const int64_t*>(bytes);
+			count = static_cast<size_t>(header.count);
+			image_hash = header.hash;
+		}
+
+		if (!verify())
+			throw std::runtime_error("hash mismatch in program image " + filepath);
+	}
+
+	const int64_t* words() const { return first; }
+	size_t size() const { return count; }
+
+	// taken from the image header when there is one, after checking it
+	uint64_t hash() const { return image_hash; }
+
+	bool verify() const
+	{
+		return program_hash(first, count) == image_hash;
+	}
+
+	std::vector<int64_t> to_vector() const
+	{
+		return { first, first + count };
+	}
+
+private:
+	void use_decoded(uint64_t hash)
+	{
+		first = decoded.data();
+		count = decoded.size();
+		image_hash = hash;
+	}
+
+	std::unique_ptr<MappedFile> mapping;
+	std::vector<int64_t> decoded;
+
+	const int64_t* first = nullptr;
+	size_t count = 0;
+	uint64_t image_hash = 0;
+};
@@ -0,0 +1,240 @@
+#pragma once
+
+#include <deque>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+#include "intcode.hpp"
+
+/**
+	Single-threaded simulation of a network of Intcode NICs (day 23), fully deterministic.
+
+	Machines are stepped in rounds, in address order. In its turn a machine gets every packet queued
+	for its address, or no_packet when there is none, and runs until it asks for input again.
+	The packets it sends are appended to the queues of their addresses, or handed to the NAT.
+
+	A round in which no machine received or sent anything leaves every machine polling an empty queue,
+	the network is idle then and the NAT decides what to do: nat.idle() returns the packet to inject,
+	or nothing to stop the simulation. Any type with these members works as a NAT:
+
+		void receive(const IntcodeNetwork::packet_t& packet);
+		std::optional<IntcodeNetwork::packet_t> idle();
+*/
+struct IntcodeNetwork
+{
+	static constexpr int64_t nat_address = 255;
+	static constexpr int64_t no_packet = -1;
+
+	struct packet_t
+	{
+		int64_t address;
+		int64_t x;
+		int64_t y;
+	};
+
+	IntcodeNetwork(const std::vector<int64_t>& program, size_t size, engine_t engine = engine_t::dispatch) :
+		queues(size), halted(size, false)
+	{
+		machines.reserve(size);
+
+		for (size_t address = 0; address < size; address++)
+		{
+			machines.emplace_back(program);
+			machines.back().engine = engine;
+			machines.back().input_channel.push(static_cast<int64_t>(address));
+		}
+	}
+
+	size_t size() const
+	{
+		return machines.size();
+	}
+
+	// for setting limits, the machine at address runs in its turn of every round
+	IntcodeVM& machine(size_t address)
+	{
+		return machines[address];
+	}
+
+	/**
+		Runs rounds until the NAT stops the simulation, every machine halted or max_rounds is reached.
+		Returns false in the last case, and when a machine was interrupted by its limits: interrupted then
+		holds its address, and the next run() continues the round with that machine.
+	*/
+	template <typename Nat>
+	bool run(Nat& nat, size_t max_rounds = std::numeric_limits<size_t>::max())
+	{
+		auto resumed = interrupted;
+		interrupted.reset();
+
+		while (true)
+		{
+			if (!in_round)
+			{
+				if (rounds >= max_rounds)
+					return false;
+
+				rounds++;
+				in_round = true;
+				busy = false;
+				running = false;
+			}
+
+			for (; next_address < machines.size(); next_address++)
+			{
+				if (halted[next_address])
+					continue;
+
+				running = true;
+				busy |= step(next_address, nat, resumed == next_address);
+				resumed.reset();
+
+				if (interrupted)
+					return false;
+			}
+
+			in_round = false;
+			next_address = 0;
+
+			if (!running)
+				return true;
+
+			if (busy)
+				continue;
+
+			idle_rounds++;
+
+			auto packet = nat.idle();
+			if (!packet)
+				return true;
+
+			send(*packet, nat);
+		}
+	}
+
+	uint64_t packets() const
+	{
+		return packet_count;
+	}
+
+	size_t rounds = 0;
+	size_t idle_rounds = 0;
+
+	std::optional<size_t> interrupted;
+
+private:
+	template <typename Nat>
+	void send(const packet_t& packet, Nat& nat)
+	{
+		packet_count++;
+
+		if (packet.address == nat_address)
+		{
+			nat.receive(packet);
+			return;
+		}
+
+		if (packet.address < 0 || static_cast<size_t>(packet.address) >= queues.size())
+			throw std::out_of_range("packet sent to an address outside of the network");
+
+		queues[static_cast<size_t>(packet.address)].push_back(packet);
+	}
+
+	// runs the machine until it waits for input or is interrupted, returns whether it received or sent anything
+	template <typename Nat>
+	bool step(size_t address, Nat& nat, bool resumed)
+	{
+		auto& machine = machines[address];
+		auto& queue = queues[address];
+
+		bool busy = !queue.empty();
+
+		// an interrupted machine may not have taken the no_packet of its last turn yet
+		if (queue.empty() && !resumed)
+			machine.input_channel.push(no_packet);
+
+		execution_state_t state;
+
+		do
+		{
+			while (!queue.empty() && machine.input_channel.capacity() - machine.input_channel.size() >= 2)
+			{
+				machine.input_channel.push(queue.front().x);
+				machine.input_channel.push(queue.front().y);
+				queue.pop_front();
+			}
+
+			state = machine.run();
+
+			// an unfinished packet stays in the channel until the machine runs again
+			auto& output = machine.output_channel;
+			while (output.size() >= 3)
+			{
+				auto destination = output.pop();
+				auto x = output.pop();
+				auto y = output.pop();
+
+				send({ destination, x, y }, nat);
+				busy = true;
+			}
+		} while (state == execution_state_t::provided_value || (state == execution_state_t::requested_value && !queue.empty()));
+
+		halted[address] = state == execution_state_t::halted;
+
+		if (state == execution_state_t::interrupted)
+			interrupted = address;
+
+		return busy;
+	}
+
+	std::vector<IntcodeVM> machines;
+	std::vector<std::deque<packet_t>> queues;
+	std::vector<bool> halted;
+	uint64_t packet_count = 0;
+
+	// where an interrupted round continues
+	bool in_round = false;
+	size_t next_address = 0;
+	bool busy = false;
+	bool running = false;
+};
+
+/**
+	The NAT of day 23: remembers the last packet it received and sends it to address 0 whenever
+	the network is idle, until it would send the same y twice in a row.
+*/
+struct RepeatingNat
+{
+	std::optional<IntcodeNetwork::packet_t> first_received;
+	std::optional<IntcodeNetwork::packet_t> last_received;
+	std::optional<int64_t> repeated_y;
+
+	void receive(const IntcodeNetwork::packet_t& packet)
+	{
+		if (!first_received)
+			first_received = packet;
+
+		last_received = packet;
+	}
+
+	std::optional<IntcodeNetwork::packet_t> idle()
+	{
+		if (!last_received)
+			return std::nullopt;
+
+		if (last_sent_y == last_received->y)
+		{
+			repeated_y = last_sent_y;
+			return std::nullopt;
+		}
+
+		last_sent_y = last_received->y;
+
+		return IntcodeNetwork::packet_t{ 0, last_received->x, last_received->y };
+	}
+
+private:
+	std::optional<int64_t> last_sent_y;
+};
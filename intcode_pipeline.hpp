@@ -0,0 +1,223 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "intcode.hpp"
+
+/**
+	A chain of VMs (day 7 amplifiers) connected by their channels: whatever a stage outputs is moved
+	into the next stage's input channel as soon as the stage stops, without a run() call per value.
+	With feedback the last stage feeds the first one again.
+
+	Stages run in turns, each until it halts or waits for input, for as long as any of them makes progress:
+	consumes input, produces output, halts or has output moved on. Output for a halted stage is dropped.
+	VMs come from a pool, so a pipeline can be rerun with new phases without building fresh VMs.
+*/
+struct IntcodePipeline
+{
+	explicit IntcodePipeline(IntcodeVMPool& pool) : pool(pool) {}
+
+	/**
+		Every stage first gets its phase, the first stage then gets input.
+		Returns the last value the last stage produced, if it produced any.
+	*/
+	std::optional<int64_t> run(const int64_t* phases, size_t length, int64_t input, bool feedback)
+	{
+		std::vector<IntcodeVMPool::lease_t> stages;
+		stages.reserve(length);
+
+		for (size_t i = 0; i < length; i++)
+		{
+			stages.push_back(pool.acquire());
+			stages.back()->input_channel.push(phases[i]);
+		}
+
+		if (length)
+			stages.front()->input_channel.push(input);
+
+		std::vector<bool> halted(length, false);
+		std::optional<int64_t> signal;
+
+		bool progress = true;
+		while (progress)
+		{
+			progress = false;
+
+			for (size_t i = 0; i < length; i++)
+			{
+				if (halted[i])
+					continue;
+
+				auto& stage = *stages[i];
+				auto waiting = stage.input_channel.size();
+				auto produced = stage.output_channel.size();
+
+				halted[i] = stage.run() == execution_state_t::halted;
+				progress |= halted[i] || stage.input_channel.size() != waiting || stage.output_channel.size() != produced;
+
+				bool last = i + 1 == length;
+				auto consumer = last ? 0 : i + 1;
+
+				if (last && !stage.output_channel.empty())
+					signal = stage.output_channel.back();
+
+				// a halted stage reads nothing any more, what is left for it is dropped
+				if ((last && !feedback) || halted[consumer])
+					stage.output_channel.clear();
+				else
+					progress |= transfer(stage.output_channel, stages[consumer]->input_channel) != 0;
+			}
+		}
+
+		return signal;
+	}
+
+private:
+	// moves as much as fits, in contiguous runs, and returns how many values moved
+	static size_t transfer(IntcodeChannel& from, IntcodeChannel& to)
+	{
+		size_t moved = 0;
+
+		while (!from.empty() && !to.full())
+		{
+			auto source = from.readable();
+			auto destination = to.writable();
+			auto count = std::min(source.size, destination.size);
+
+			std::copy(source.data, source.data + count, destination.data);
+			from.consume(count);
+			to.commit(count);
+			moved += count;
+		}
+
+		return moved;
+	}
+
+	IntcodeVMPool& pool;
+};
+
+struct PhaseSearchResult
+{
+	int64_t signal;
+	std::vector<int64_t> phases;
+};
+
+/**
+	Tries every ordering of length distinct phases out of the alphabet on a pipeline fed with 0,
+	returns the strongest signal and the phases producing it (the first one in lexicographic order on ties).
+
+	Orderings are numbered lexicographically, workers take chunks of consecutive numbers from a shared counter,
+	decode where their chunk starts and step through it with std::next_permutation.
+*/
+inline PhaseSearchResult search_phases(
+	const std::vector<int64_t>& program,
+	std::vector<int64_t> alphabet,
+	size_t length,
+	bool feedback,
+	size_t thread_count = std::thread::hardware_concurrency())
+{
+	constexpr uint64_t chunk_size = 64;
+
+	std::sort(alphabet.begin(), alphabet.end());
+	length = std::min(length, alphabet.size());
+
+	// alphabet.size()! / (alphabet.size() - length)! orderings
+	uint64_t total = 1;
+	for (size_t i = 0; i < length; i++)
+		total *= alphabet.size() - i;
+
+	IntcodeVMPool pool(program);
+	std::atomic<uint64_t> next_chunk{ 0 };
+
+	std::mutex best_mutex;
+	std::optional<std::pair<uint64_t, PhaseSearchResult>> best;
+	std::exception_ptr error;
+
+	auto search = [&]
+	{
+		IntcodePipeline pipeline(pool);
+		std::optional<std::pair<uint64_t, PhaseSearchResult>> local_best;
+
+		for (uint64_t first = next_chunk.fetch_add(chunk_size); first < total; first = next_chunk.fetch_add(chunk_size))
+		{
+			// the digits of first in the mixed radix (n, n - 1, ...) pick from the remaining phases in order
+			auto remaining = alphabet;
+			std::vector<int64_t> phases;
+
+			uint64_t radix = total;
+			uint64_t rest = first;
+			for (size_t i = 0; i < length; i++)
+			{
+				radix /= alphabet.size() - i;
+				auto digit = static_cast<size_t>(rest / radix);
+				rest %= radix;
+
+				phases.push_back(remaining[digit]);
+				remaining.erase(remaining.begin() + digit);
+			}
+
+			phases.insert(phases.end(), remaining.begin(), remaining.end());
+
+			for (uint64_t number = first; number < std::min(first + chunk_size, total); number++)
+			{
+				auto signal = pipeline.run(phases.data(), length, 0, feedback);
+
+				// numbers only grow within a worker, so the first of equal signals is kept
+				if (signal && (!local_best || *signal > local_best->second.signal))
+					local_best = { number, { *signal, { phases.begin(), phases.begin() + length } } };
+
+				// the unused phases stay sorted behind the chosen ones, reversing them moves on to the next prefix
+				std::reverse(phases.begin() + length, phases.end());
+				std::next_permutation(phases.begin(), phases.end());
+			}
+		}
+
+		if (!local_best)
+			return;
+
+		std::lock_guard<std::mutex> lock(best_mutex);
+
+		auto& [number, result] = *local_best;
+		if (!best || result.signal > best->second.signal || (result.signal == best->second.signal && number < best->first))
+			best = local_best;
+	};
+
+	// a program failing on some phases fails the whole search, on the calling thread
+	auto worker = [&]
+	{
+		try
+		{
+			search();
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock(best_mutex);
+			error = std::current_exception();
+			next_chunk = total;
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for (size_t i = 1; i < std::max<size_t>(thread_count, 1); i++)
+		workers.emplace_back(worker);
+
+	worker();
+
+	for (auto& thread : workers)
+		thread.join();
+
+	if (error)
+		std::rethrow_exception(error);
+
+	if (!best)
+		throw std::runtime_error("no phase setting produced a signal");
+
+	return best->second;
+}
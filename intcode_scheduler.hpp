@@ -0,0 +1,337 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "intcode.hpp"
+
+/**
+	Runs any number of VMs on a fixed pool of worker threads.
+
+	Every worker has its own run queue, it takes machines from the front of it and when it is empty steals
+	from the back of another worker's queue. A machine is only queued while it can make progress: at the start,
+	after it filled its output channel, or when values are delivered to it. A machine waiting for input
+	with an empty mailbox is parked and costs nothing until something is delivered.
+
+	Programs which poll for input (like the day 23 network, which reads -1 when no packet arrived) get
+	poll_value once instead of parking straight away. If they come back for input without having produced
+	any output since, they are parked as idle.
+
+	When no machine is queued or running the network is idle and on_idle runs, it may deliver values and
+	return true to continue. The run ends when it returns false or when nothing was delivered.
+*/
+struct IntcodeScheduler
+{
+	using machine_id_t = size_t;
+
+	// called on a worker after a machine ran, with the machine's output channel; may deliver to other machines
+	using output_handler_t = std::function<void(machine_id_t, IntcodeChannel&)>;
+	using idle_handler_t = std::function<bool()>;
+
+	std::optional<int64_t> poll_value;
+
+	explicit IntcodeScheduler(size_t worker_count = std::thread::hardware_concurrency()) :
+		queues(std::max<size_t>(worker_count, 1)) {}
+
+	machine_id_t add(IntcodeVM vm)
+	{
+		machines.push_back(std::make_unique<Machine>(std::move(vm)));
+
+		return machines.size() - 1;
+	}
+
+	size_t size() const
+	{
+		return machines.size();
+	}
+
+	IntcodeVM& vm(machine_id_t id)
+	{
+		return machines[id]->vm;
+	}
+
+	/**
+		Appends the values to the machine's mailbox at once, so a machine never sees half a packet.
+		Safe to call from handlers and other threads while the scheduler runs.
+	*/
+	void deliver(machine_id_t id, std::initializer_list<int64_t> values)
+	{
+		auto& machine = *machines[id];
+		bool wake = false;
+
+		{
+			std::lock_guard<std::mutex> lock(machine.mutex);
+
+			machine.mailbox.insert(machine.mailbox.end(), values.begin(), values.end());
+
+			if (machine.state == state_t::parked)
+			{
+				machine.state = state_t::queued;
+				wake = true;
+			}
+		}
+
+		if (wake)
+			enqueue(id);
+	}
+
+	void run(output_handler_t on_output, idle_handler_t on_idle = [] { return false; })
+	{
+		output_handler = std::move(on_output);
+		idle_handler = std::move(on_idle);
+		finished = false;
+
+		for (machine_id_t id = 0; id < machines.size(); id++)
+		{
+			if (machines[id]->state == state_t::halted)
+				continue;
+
+			machines[id]->state = state_t::queued;
+			enqueue(id);
+		}
+
+		if (!pending)
+			finish_if_idle();
+
+		std::vector<std::thread> workers;
+
+		for (size_t worker = 1; worker < queues.size(); worker++)
+			workers.emplace_back(&IntcodeScheduler::work, this, worker);
+
+		work(0);
+
+		for (auto& worker : workers)
+			worker.join();
+	}
+
+	// machine slices run so far, for measuring throughput
+	uint64_t slices() const
+	{
+		return slice_count.load();
+	}
+
+private:
+	enum class state_t
+	{
+		parked,
+		queued,
+		running,
+		halted
+	};
+
+	struct Machine
+	{
+		explicit Machine(IntcodeVM vm) : vm(std::move(vm)) {}
+
+		IntcodeVM vm;
+
+		std::mutex mutex;
+		std::deque<int64_t> mailbox;
+		state_t state = state_t::parked;
+
+		// got poll_value and produced no output since
+		bool polled = false;
+	};
+
+	struct RunQueue
+	{
+		std::mutex mutex;
+		std::deque<machine_id_t> machines;
+	};
+
+	struct worker_t
+	{
+		const IntcodeScheduler* scheduler;
+		size_t index;
+	};
+
+	static worker_t& current_worker()
+	{
+		static thread_local worker_t worker{ nullptr, 0 };
+
+		return worker;
+	}
+
+	void enqueue(machine_id_t id)
+	{
+		pending++;
+		enqueued++;
+
+		// machines woken up by one of our workers stay on it, others are spread over the queues
+		auto& worker = current_worker();
+		auto& queue = queues[worker.scheduler == this ? worker.index : id % queues.size()];
+
+		{
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			queue.machines.push_back(id);
+		}
+
+		std::lock_guard<std::mutex> lock(sleep_mutex);
+		wake_up.notify_one();
+	}
+
+	std::optional<machine_id_t> take(size_t worker)
+	{
+		for (size_t i = 0; i < queues.size(); i++)
+		{
+			auto& queue = queues[(worker + i) % queues.size()];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+
+			if (queue.machines.empty())
+				continue;
+
+			machine_id_t id;
+
+			if (i == 0)
+			{
+				id = queue.machines.front();
+				queue.machines.pop_front();
+			}
+			else
+			{
+				id = queue.machines.back();
+				queue.machines.pop_back();
+			}
+
+			return id;
+		}
+
+		return std::nullopt;
+	}
+
+	void work(size_t worker)
+	{
+		current_worker() = { this, worker };
+
+		while (!finished)
+		{
+			auto id = take(worker);
+
+			/*
+				enqueue and finish_if_idle notify under sleep_mutex, so a worker sleeps until there is work.
+				pending only falls short of the queued machines while a worker is between finishing
+				a slice and taking its next machine, and that worker finds them itself.
+			*/
+			if (!id)
+			{
+				std::unique_lock<std::mutex> lock(sleep_mutex);
+				wake_up.wait(lock, [&] { return finished || pending > running; });
+				continue;
+			}
+
+			running++;
+			run_slice(*id);
+			running--;
+		}
+
+		current_worker() = { nullptr, 0 };
+	}
+
+	void run_slice(machine_id_t id)
+	{
+		auto& machine = *machines[id];
+		auto& vm = machine.vm;
+
+		{
+			std::lock_guard<std::mutex> lock(machine.mutex);
+
+			machine.state = state_t::running;
+
+			while (!machine.mailbox.empty() && !vm.input_channel.full())
+			{
+				vm.input_channel.push(machine.mailbox.front());
+				machine.mailbox.pop_front();
+				machine.polled = false;
+			}
+		}
+
+		auto state = vm.run();
+		slice_count++;
+
+		if (!vm.output_channel.empty())
+		{
+			machine.polled = false;
+			output_handler(id, vm.output_channel);
+		}
+
+		bool requeue = false;
+
+		{
+			std::lock_guard<std::mutex> lock(machine.mutex);
+
+			// a machine stopped by its limits leaves the network like a halted one
+			if (state == execution_state_t::halted || state == execution_state_t::interrupted)
+			{
+				machine.state = state_t::halted;
+			}
+			else if (state == execution_state_t::provided_value || !machine.mailbox.empty())
+			{
+				requeue = true;
+			}
+			else if (poll_value && !machine.polled)
+			{
+				vm.input_channel.push(*poll_value);
+				machine.polled = true;
+				requeue = true;
+			}
+			else
+			{
+				machine.state = state_t::parked;
+			}
+
+			if (requeue)
+				machine.state = state_t::queued;
+		}
+
+		if (requeue)
+			enqueue(id);
+
+		if (--pending == 0)
+			finish_if_idle();
+	}
+
+	void finish_if_idle()
+	{
+		std::lock_guard<std::mutex> idle_lock(idle_mutex);
+
+		// a delivery from outside may have raced with the last machine parking
+		if (pending)
+			return;
+
+		auto before = enqueued.load();
+
+		// machines woken up by the handler may already have parked again, they will come back here then
+		if (!idle_handler() || enqueued == before)
+		{
+			finished = true;
+
+			std::lock_guard<std::mutex> lock(sleep_mutex);
+			wake_up.notify_all();
+		}
+	}
+
+	std::vector<std::unique_ptr<Machine>> machines;
+	std::vector<RunQueue> queues;
+
+	output_handler_t output_handler;
+	idle_handler_t idle_handler;
+
+	// machines queued or running
+	std::atomic<size_t> pending{ 0 };
+	std::atomic<size_t> running{ 0 };
+	std::atomic<uint64_t> enqueued{ 0 };
+	std::atomic<bool> finished{ false };
+	std::atomic<uint64_t> slice_count{ 0 };
+
+	std::mutex idle_mutex;
+	std::mutex sleep_mutex;
+	std::condition_variable wake_up;
+};
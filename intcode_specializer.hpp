@@ -0,0 +1,671 @@
+#pragma once
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "intcode.hpp"
+
+/**
+	Node of the expression graph built by the specializer. Nodes only refer to nodes created before them,
+	so the graph is evaluated in index order.
+
+	Every node also tracks whether it is a linear combination of the parameters, that is the case for
+	most of the arithmetic Intcode programs do on their inputs and gives a direct formula.
+*/
+struct SymbolicExpression
+{
+	enum class kind_t
+	{
+		constant,
+		parameter,
+		// cell of the initial memory at a computed address
+		load,
+		add,
+		multiply,
+		less_than,
+		equals
+	};
+
+	kind_t kind;
+
+	// value of a constant, index of a parameter
+	int64_t value = 0;
+
+	size_t lhs = 0;
+	size_t rhs = 0;
+
+	bool linear = false;
+	std::vector<int64_t> coefficients;
+	int64_t offset = 0;
+};
+
+/**
+	Initial memory of a specialized program: the image with its fixed cells applied.
+	Parameter cells hold the arguments of an evaluation.
+*/
+struct SpecializedImage
+{
+	std::vector<int64_t> image;
+	std::vector<int64_t> parameters;
+	std::vector<SymbolicExpression> nodes;
+
+	int64_t initial(int64_t address, const std::vector<int64_t>& arguments) const
+	{
+		for (size_t i = 0; i < parameters.size(); i++)
+		{
+			if (parameters[i] == address)
+				return arguments[i];
+		}
+
+		return address >= 0 && address < static_cast<int64_t>(image.size()) ? image[static_cast<size_t>(address)] : 0;
+	}
+};
+
+/**
+	Value of one cell as a function of the parameter cells, in the order they were passed to specialize().
+*/
+struct Formula
+{
+	std::shared_ptr<const SpecializedImage> specialized;
+	size_t root;
+
+	int64_t operator()(const std::vector<int64_t>& arguments) const
+	{
+		auto& nodes = specialized->nodes;
+		auto& node = nodes[root];
+
+		if (node.linear)
+		{
+			auto value = node.offset;
+
+			for (size_t i = 0; i < arguments.size(); i++)
+				value += node.coefficients[i] * arguments[i];
+
+			return value;
+		}
+
+		std::vector<int64_t> values(root + 1);
+
+		for (size_t i = 0; i <= root; i++)
+		{
+			auto& current = nodes[i];
+
+			switch (current.kind)
+			{
+			case SymbolicExpression::kind_t::constant:	values[i] = current.value; break;
+			case SymbolicExpression::kind_t::parameter:	values[i] = arguments[static_cast<size_t>(current.value)]; break;
+			case SymbolicExpression::kind_t::load:		values[i] = specialized->initial(values[current.lhs], arguments); break;
+			case SymbolicExpression::kind_t::add:		values[i] = values[current.lhs] + values[current.rhs]; break;
+			case SymbolicExpression::kind_t::multiply:	values[i] = values[current.lhs] * values[current.rhs]; break;
+			case SymbolicExpression::kind_t::less_than:	values[i] = values[current.lhs] < values[current.rhs] ? 1 : 0; break;
+			case SymbolicExpression::kind_t::equals:	values[i] = values[current.lhs] == values[current.rhs] ? 1 : 0; break;
+			}
+		}
+
+		return values[root];
+	}
+
+	bool is_constant() const
+	{
+		return specialized->nodes[root].kind == SymbolicExpression::kind_t::constant;
+	}
+
+	// parameters are written as m<address>
+	std::string to_string() const
+	{
+		return to_string(root);
+	}
+
+private:
+	std::string to_string(size_t index) const
+	{
+		auto& node = specialized->nodes[index];
+		auto parameter = [&](size_t i) { return "m" + std::to_string(specialized->parameters[i]); };
+
+		if (node.linear && node.kind != SymbolicExpression::kind_t::constant)
+		{
+			std::ostringstream terms;
+
+			for (size_t i = 0; i < node.coefficients.size(); i++)
+			{
+				if (node.coefficients[i])
+					terms << (terms.tellp() ? " + " : "") << node.coefficients[i] << " * " << parameter(i);
+			}
+
+			if (node.offset)
+				terms << " + " << node.offset;
+
+			return terms.str();
+		}
+
+		switch (node.kind)
+		{
+		case SymbolicExpression::kind_t::constant:	return std::to_string(node.value);
+		case SymbolicExpression::kind_t::parameter:	return parameter(static_cast<size_t>(node.value));
+		case SymbolicExpression::kind_t::load:		return "m[" + to_string(node.lhs) + "]";
+		case SymbolicExpression::kind_t::add:		return "(" + to_string(node.lhs) + " + " + to_string(node.rhs) + ")";
+		case SymbolicExpression::kind_t::multiply:	return "(" + to_string(node.lhs) + " * " + to_string(node.rhs) + ")";
+		case SymbolicExpression::kind_t::less_than:	return "(" + to_string(node.lhs) + " < " + to_string(node.rhs) + ")";
+		default:									return "(" + to_string(node.lhs) + " == " + to_string(node.rhs) + ")";
+		}
+	}
+};
+
+/**
+	Memory and entry point of a residual program. Its scratch cells and code live at code_base, far above
+	anything programs use as heap or stack through the relative base, so the cells past the image keep their zeros.
+	Create the VM with vm(), then write the parameter cells like for the original program.
+*/
+struct ResidualProgram
+{
+	static constexpr int64_t code_base = int64_t(1) << 40;
+
+	std::vector<int64_t> image;
+
+	// scratch cells followed by the instructions, starting at code_base
+	std::vector<int64_t> code;
+	int64_t entry;
+
+	IntcodeVM vm() const
+	{
+		IntcodeVM vm(image, entry);
+
+		for (size_t i = 0; i < code.size(); i++)
+			vm.memory[code_base + static_cast<int64_t>(i)] = code[i];
+
+		return vm;
+	}
+};
+
+/**
+	Outcome of specialize(). The original program ran up to instruction_pointer, where it either halted
+	(complete) or reached something that could not be evaluated ahead of time, explained by stopped_because.
+	Every cell the prefix wrote has a formula over the parameters.
+*/
+struct Specialization
+{
+	std::shared_ptr<SpecializedImage> specialized;
+
+	bool complete = false;
+	std::string stopped_because;
+	size_t evaluated_instructions = 0;
+
+	int64_t instruction_pointer = 0;
+	int64_t relative_base = 0;
+
+	// cells written so far and the node holding their value
+	std::map<int64_t, size_t> written;
+
+	// cells the program never wrote get a constant node on first use
+	Formula formula(int64_t cell)
+	{
+		auto value = written.find(cell);
+
+		if (value != written.end())
+			return { specialized, value->second };
+
+		for (size_t i = 0; i < specialized->parameters.size(); i++)
+		{
+			if (specialized->parameters[i] == cell)
+				return { specialized, parameter_nodes[i] };
+		}
+
+		specialized->nodes.push_back({ SymbolicExpression::kind_t::constant, specialized->initial(cell, {}) });
+		specialized->nodes.back().linear = true;
+		specialized->nodes.back().coefficients.assign(specialized->parameters.size(), 0);
+		specialized->nodes.back().offset = specialized->nodes.back().value;
+
+		return { specialized, specialized->nodes.size() - 1 };
+	}
+
+	/**
+		The original image and straight-line code which copies the parameters into scratch cells, computes
+		the written cells from the copies into scratch cells (parameters may be among the written cells, so
+		nothing reads them once the first one is stored), stores them, restores the relative base and jumps
+		to where the original program continues.
+		Linear values are computed from their formula instead of the operations which produced them.
+
+		Only the live cells are stored, by default all written ones. For a program which did not halt yet,
+		the live cells must include everything the rest of the program reads.
+	*/
+	ResidualProgram residual(const std::vector<int64_t>& live = {}) const
+	{
+		using kind_t = SymbolicExpression::kind_t;
+
+		auto& nodes = specialized->nodes;
+		auto& parameters = specialized->parameters;
+
+		ResidualProgram program{ specialized->image, {}, 0 };
+		auto& code = program.code;
+
+		std::map<int64_t, size_t> stored;
+		for (auto [cell, node] : written)
+		{
+			if (live.empty() || std::find(live.begin(), live.end(), cell) != live.end())
+				stored[cell] = node;
+		}
+
+		auto is_leaf = [&](size_t node) { return nodes[node].kind == kind_t::constant || nodes[node].kind == kind_t::parameter; };
+
+		// which nodes the stored cells depend on
+		std::vector<bool> needed(nodes.size(), false);
+		for (auto [cell, node] : stored)
+			needed[node] = true;
+
+		for (size_t i = nodes.size(); i-- > 0;)
+		{
+			if (!needed[i] || is_leaf(i) || nodes[i].linear)
+				continue;
+
+			needed[nodes[i].lhs] = true;
+
+			if (nodes[i].kind != kind_t::load)
+				needed[nodes[i].rhs] = true;
+		}
+
+		auto scratch = ResidualProgram::code_base;
+
+		std::vector<int64_t> parameter_copy(parameters.size());
+		for (auto& copy : parameter_copy)
+			copy = scratch++;
+
+		std::vector<int64_t> location(nodes.size(), 0);
+
+		for (size_t i = 0; i < nodes.size(); i++)
+		{
+			if (needed[i] && !is_leaf(i))
+				location[i] = scratch++;
+		}
+
+		// partial products of linear values
+		auto product = scratch++;
+		program.entry = scratch;
+		code.assign(static_cast<size_t>(scratch - ResidualProgram::code_base), 0);
+
+		// immediate mode for constants, positional for everything else
+		auto operand = [&](size_t node, int64_t& mode)
+		{
+			if (nodes[node].kind == kind_t::constant)
+			{
+				mode = 1;
+				return nodes[node].value;
+			}
+
+			mode = 0;
+
+			if (nodes[node].kind == kind_t::parameter)
+				return parameter_copy[static_cast<size_t>(nodes[node].value)];
+
+			return location[node];
+		};
+
+		auto emit = [&](int64_t opcode, int64_t a, int64_t a_mode, int64_t b, int64_t b_mode, int64_t destination)
+		{
+			code.insert(code.end(), { opcode + 100 * a_mode + 1000 * b_mode, a, b, destination });
+		};
+
+		auto emit_nodes = [&](int64_t opcode, size_t lhs, size_t rhs, int64_t destination)
+		{
+			int64_t a_mode = 0;
+			int64_t b_mode = 0;
+			auto a = operand(lhs, a_mode);
+			auto b = operand(rhs, b_mode);
+
+			emit(opcode, a, a_mode, b, b_mode, destination);
+		};
+
+		for (size_t p = 0; p < parameters.size(); p++)
+			emit(1, parameters[p], 0, 0, 1, parameter_copy[p]);
+
+		for (size_t i = 0; i < nodes.size(); i++)
+		{
+			auto& node = nodes[i];
+
+			if (!needed[i] || is_leaf(i))
+				continue;
+
+			if (node.linear)
+			{
+				emit(1, node.offset, 1, 0, 1, location[i]);
+
+				for (size_t p = 0; p < node.coefficients.size(); p++)
+				{
+					if (!node.coefficients[p])
+						continue;
+
+					emit(2, node.coefficients[p], 1, parameter_copy[p], 0, product);
+					emit(1, product, 0, location[i], 0, location[i]);
+				}
+
+				continue;
+			}
+
+			switch (node.kind)
+			{
+			case kind_t::load:
+			{
+				// patch the address into the argument of the following add
+				int64_t mode = 0;
+				auto address = operand(node.lhs, mode);
+				auto argument_cell = ResidualProgram::code_base + static_cast<int64_t>(code.size()) + 5;
+
+				emit(1, address, mode, 0, 1, argument_cell);
+				emit(1, 0, 0, 0, 1, location[i]);
+				break;
+			}
+
+			case kind_t::add:		emit_nodes(1, node.lhs, node.rhs, location[i]); break;
+			case kind_t::multiply:	emit_nodes(2, node.lhs, node.rhs, location[i]); break;
+			case kind_t::less_than:	emit_nodes(7, node.lhs, node.rhs, location[i]); break;
+			default:				emit_nodes(8, node.lhs, node.rhs, location[i]); break;
+			}
+		}
+
+		for (auto [cell, node] : stored)
+		{
+			int64_t mode = 0;
+			auto value = operand(node, mode);
+
+			emit(1, value, mode, 0, 1, cell);
+		}
+
+		code.insert(code.end(), { 109, relative_base, 1105, 1, instruction_pointer });
+
+		return program;
+	}
+
+	std::vector<size_t> parameter_nodes;
+};
+
+/**
+	Partial evaluation of a program whose image is known except for the parameter cells, with some cells
+	fixed to given values beforehand (like the coins of day 13 or noun and verb of day 2 part 1).
+
+	The program is executed symbolically from address 0: constants are folded and values depending on
+	parameters become expressions. Specialization stops at input and output, and at the first instruction
+	whose opcode, jump condition, jump target, destination or relative base adjustment depends on a parameter.
+	Loads from an address which depends on a parameter are allowed until the first store.
+*/
+inline Specialization specialize(
+	const std::vector<int64_t>& program,
+	const std::map<int64_t, int64_t>& fixed,
+	const std::vector<int64_t>& parameters,
+	size_t max_steps = 1000000)
+{
+	auto specialized = std::make_shared<SpecializedImage>();
+	specialized->image = program;
+	specialized->parameters = parameters;
+
+	for (auto [cell, value] : fixed)
+	{
+		if (cell >= static_cast<int64_t>(specialized->image.size()))
+			specialized->image.resize(static_cast<size_t>(cell + 1), 0);
+
+		specialized->image[static_cast<size_t>(cell)] = value;
+	}
+
+	Specialization result;
+	result.specialized = specialized;
+
+	auto& nodes = specialized->nodes;
+	auto parameter_count = parameters.size();
+
+	std::map<int64_t, size_t> constants;
+
+	auto constant = [&](int64_t value)
+	{
+		auto known = constants.find(value);
+		if (known != constants.end())
+			return known->second;
+
+		SymbolicExpression node{ SymbolicExpression::kind_t::constant, value };
+		node.linear = true;
+		node.coefficients.assign(parameter_count, 0);
+		node.offset = value;
+
+		nodes.push_back(node);
+
+		return constants[value] = nodes.size() - 1;
+	};
+
+	for (size_t i = 0; i < parameter_count; i++)
+	{
+		SymbolicExpression node{ SymbolicExpression::kind_t::parameter, static_cast<int64_t>(i) };
+		node.linear = true;
+		node.coefficients.assign(parameter_count, 0);
+		node.coefficients[i] = 1;
+
+		nodes.push_back(node);
+		result.parameter_nodes.push_back(nodes.size() - 1);
+	}
+
+	auto is_constant = [&](size_t node) { return nodes[node].kind == SymbolicExpression::kind_t::constant; };
+
+	auto combine = [&](SymbolicExpression::kind_t kind, size_t lhs, size_t rhs) -> size_t
+	{
+		using kind_t = SymbolicExpression::kind_t;
+
+		if (is_constant(lhs) && is_constant(rhs))
+		{
+			auto a = nodes[lhs].value;
+			auto b = nodes[rhs].value;
+
+			switch (kind)
+			{
+			case kind_t::add:		return constant(a + b);
+			case kind_t::multiply:	return constant(a * b);
+			case kind_t::less_than:	return constant(a < b ? 1 : 0);
+			default:				return constant(a == b ? 1 : 0);
+			}
+		}
+
+		if (kind == kind_t::add && is_constant(lhs) && nodes[lhs].value == 0)
+			return rhs;
+
+		if (kind == kind_t::add && is_constant(rhs) && nodes[rhs].value == 0)
+			return lhs;
+
+		if (kind == kind_t::multiply && ((is_constant(lhs) && nodes[lhs].value == 0) || (is_constant(rhs) && nodes[rhs].value == 0)))
+			return constant(0);
+
+		if (kind == kind_t::multiply && is_constant(lhs) && nodes[lhs].value == 1)
+			return rhs;
+
+		if (kind == kind_t::multiply && is_constant(rhs) && nodes[rhs].value == 1)
+			return lhs;
+
+		SymbolicExpression node{ kind, 0, lhs, rhs };
+		auto& a = nodes[lhs];
+		auto& b = nodes[rhs];
+
+		if (kind == kind_t::add && a.linear && b.linear)
+		{
+			node.linear = true;
+			node.offset = a.offset + b.offset;
+
+			for (size_t i = 0; i < parameter_count; i++)
+				node.coefficients.push_back(a.coefficients[i] + b.coefficients[i]);
+		}
+		else if (kind == kind_t::multiply && a.linear && b.linear && (is_constant(lhs) || is_constant(rhs)))
+		{
+			auto factor = is_constant(lhs) ? a.value : b.value;
+			auto& scaled = is_constant(lhs) ? b : a;
+
+			node.linear = true;
+			node.offset = scaled.offset * factor;
+
+			for (size_t i = 0; i < parameter_count; i++)
+				node.coefficients.push_back(scaled.coefficients[i] * factor);
+		}
+
+		nodes.push_back(node);
+
+		return nodes.size() - 1;
+	};
+
+	auto& written = result.written;
+
+	auto read = [&](int64_t address) -> size_t
+	{
+		auto cell = written.find(address);
+		if (cell != written.end())
+			return cell->second;
+
+		for (size_t i = 0; i < parameter_count; i++)
+		{
+			if (parameters[i] == address)
+				return result.parameter_nodes[i];
+		}
+
+		return constant(specialized->initial(address, {}));
+	};
+
+	auto& ip = result.instruction_pointer;
+	auto& rb = result.relative_base;
+
+	auto stop = [&](const std::string& reason)
+	{
+		result.stopped_because = reason;
+		return result;
+	};
+
+	for (; result.evaluated_instructions < max_steps; result.evaluated_instructions++)
+	{
+		auto word_node = read(ip);
+
+		if (!is_constant(word_node))
+			return stop("opcode depends on a parameter");
+
+		auto word = nodes[word_node].value;
+		auto opcode = static_cast<opcode_t>(word % 100);
+
+		if (!IntcodeVM::instruction_size(word % 100))
+			return stop("invalid opcode");
+
+		auto mode = [&](int64_t n)
+		{
+			auto modes = word / 100;
+
+			for (int64_t i = 0; i < n; i++)
+				modes /= 10;
+
+			return static_cast<mode_t>(modes % 10);
+		};
+
+		// false when the operand can not be evaluated ahead of time
+		auto value = [&](int64_t n, size_t& node)
+		{
+			auto argument = read(ip + 1 + n);
+
+			if (mode(n) == mode_t::immediate)
+			{
+				node = argument;
+				return true;
+			}
+
+			if (mode(n) == mode_t::relative)
+			{
+				if (!is_constant(argument))
+					return false;
+
+				node = read(rb + nodes[argument].value);
+				return true;
+			}
+
+			if (is_constant(argument))
+			{
+				node = read(nodes[argument].value);
+				return true;
+			}
+
+			if (!written.empty())
+				return false;
+
+			nodes.push_back({ SymbolicExpression::kind_t::load, 0, argument });
+			node = nodes.size() - 1;
+			return true;
+		};
+
+		auto destination = [&](int64_t n, int64_t& address)
+		{
+			auto argument = read(ip + 1 + n);
+
+			if (!is_constant(argument) || mode(n) == mode_t::immediate)
+				return false;
+
+			address = nodes[argument].value + (mode(n) == mode_t::relative ? rb : 0);
+			return true;
+		};
+
+		size_t a = 0;
+		size_t b = 0;
+		int64_t target = 0;
+
+		switch (opcode)
+		{
+		case opcode_t::add:
+		case opcode_t::multiply:
+		case opcode_t::less_than:
+		case opcode_t::equals:
+		{
+			if (!value(0, a) || !value(1, b) || !destination(2, target))
+				return stop("operand address depends on a parameter");
+
+			auto kind =
+				opcode == opcode_t::add ? SymbolicExpression::kind_t::add :
+				opcode == opcode_t::multiply ? SymbolicExpression::kind_t::multiply :
+				opcode == opcode_t::less_than ? SymbolicExpression::kind_t::less_than : SymbolicExpression::kind_t::equals;
+
+			written[target] = combine(kind, a, b);
+			ip += 4;
+			break;
+		}
+
+		case opcode_t::jump_if_true:
+		case opcode_t::jump_if_false:
+		{
+			if (!value(0, a) || !is_constant(a))
+				return stop("jump condition depends on a parameter");
+
+			auto condition = nodes[a].value;
+			bool taken = opcode == opcode_t::jump_if_true ? condition > 0 : condition == 0;
+
+			if (!taken)
+			{
+				ip += 3;
+				break;
+			}
+
+			if (!value(1, b) || !is_constant(b))
+				return stop("jump target depends on a parameter");
+
+			ip = nodes[b].value;
+			break;
+		}
+
+		case opcode_t::adjust_base:
+			if (!value(0, a) || !is_constant(a))
+				return stop("relative base depends on a parameter");
+
+			rb += nodes[a].value;
+			ip += 2;
+			break;
+
+		case opcode_t::input:
+			return stop("input");
+
+		case opcode_t::output:
+			return stop("output");
+
+		case opcode_t::halt:
+			result.complete = true;
+			return stop("halted");
+		}
+	}
+
+	return stop("step limit");
+}
@@ -0,0 +1,256 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "intcode.hpp"
+#include "intcode_checkpoint.hpp"
+#include "intcode_coroutine.hpp"
+#include "intcode_pipeline.hpp"
+#include "intcode_scheduler.hpp"
+
+/**
+	Regression tests of the Intcode machinery, run with --self-test. A test throws on the first expectation
+	which does not hold; run_all reports every test and fails if any did.
+*/
+namespace tests {
+
+	inline void expect(bool condition, const std::string& what)
+	{
+		if (!condition)
+			throw std::runtime_error(what);
+	}
+
+	inline std::string engine_name(engine_t engine)
+	{
+		return engine == engine_t::blocks ? "blocks" : "dispatch";
+	}
+
+	// the fused move (1101 with an immediate 0) and the translated block both bake the argument the host patches
+	inline void pooled_vm_sees_host_patches()
+	{
+		std::vector<int64_t> program = { 1101, 0, 7, 5000, 4, 5000, 99 };
+
+		for (auto engine : { engine_t::dispatch, engine_t::blocks })
+		{
+			IntcodeVMPool pool(program, engine);
+			int64_t output = 0;
+
+			{
+				auto vm = pool.acquire();
+				vm->run(output);
+				expect(output == 7, engine_name(engine) + ": first lease printed " + std::to_string(output));
+			}
+
+			auto vm = pool.acquire();
+			vm->memory[1] = 3;
+			vm->run(output);
+			expect(output == 10, engine_name(engine) + ": patched lease printed " + std::to_string(output));
+		}
+	}
+
+	// stage 0 halts straight away, stage 1 keeps feeding it 5000 values it never reads
+	inline void pipeline_drops_output_for_halted_stage()
+	{
+		std::vector<int64_t> program = { 3, 100, 1005, 100, 6, 99, 104, 7, 1001, 101, 1, 101, 1007, 101, 5000, 102, 1005, 102, 6, 99 };
+		int64_t phases[] = { 0, 1 };
+
+		IntcodeVMPool pool(program);
+		auto signal = IntcodePipeline(pool).run(phases, 2, 0, true);
+
+		expect(signal == 7, "the last stage did not finish with 7");
+	}
+
+	// a header field changed after writing must fail the checksum, not size the memory read from the file
+	inline void checkpoint_rejects_edited_header()
+	{
+		auto filepath = (std::filesystem::temp_directory_path() / "intcode_test.checkpoint").string();
+
+		auto write = [&]
+		{
+			IntcodeVM vm(std::vector<int64_t>{ 1101, 2, 3, 2000, 3, 2001, 99 });
+			vm.run();
+
+			IntcodeCheckpointWriter(filepath).write(vm);
+		};
+
+		write();
+		expect(restore_checkpoint(filepath).memory.read(2000) == 5, "the intact checkpoint did not restore");
+
+		std::pair<size_t, uint64_t> edits[] = {
+			{ offsetof(checkpoint::header_t, dense_size), 4792000 },
+			{ offsetof(checkpoint::header_t, page_count), uint64_t{ 1 } << 60 },
+		};
+
+		for (auto [offset, value] : edits)
+		{
+			write();
+
+			{
+				std::fstream file(filepath, std::ios::binary | std::ios::in | std::ios::out);
+				file.seekp(static_cast<std::streamoff>(offset));
+				file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+			}
+
+			bool rejected = false;
+
+			try
+			{
+				restore_checkpoint(filepath);
+			}
+			catch (const std::runtime_error&)
+			{
+				rejected = true;
+			}
+
+			expect(rejected, "restored a checkpoint with the header word at offset " + std::to_string(offset) + " edited");
+		}
+
+		std::filesystem::remove(filepath);
+	}
+
+	// doubles every input until it reads 0, with a budget interrupting it on its way back to the input
+	inline void coroutine_awaits_input_and_yields_output()
+	{
+		IntcodeVM vm(std::vector<int64_t>{ 3, 20, 1006, 20, 14, 1002, 20, 2, 20, 4, 20, 1105, 1, 0, 99 });
+		auto coroutine = run_as_coroutine(vm);
+
+		expect(coroutine.resume() == execution_state_t::requested_value && coroutine.wants_input(), "did not wait for the first input");
+		expect(coroutine.send(3) == execution_state_t::provided_value && coroutine.output() == 6, "did not yield 6 for 3");
+
+		vm.limits.instruction_budget = 1;
+		expect(coroutine.resume() == execution_state_t::interrupted && coroutine.interrupted(), "the budget did not interrupt it");
+		expect(vm.interrupt_reason == interrupt_reason_t::budget, "interrupted for another reason than the budget");
+
+		vm.limits.instruction_budget = IntcodeLimits::unlimited;
+		expect(coroutine.resume() == execution_state_t::requested_value, "did not continue to the next input after the interrupt");
+		expect(coroutine.send(5) == execution_state_t::provided_value && coroutine.output() == 10, "did not yield 10 for 5");
+
+		coroutine.resume();
+		expect(coroutine.send(0) == execution_state_t::halted && coroutine.done(), "did not halt on 0");
+	}
+
+	/**
+		Tokens pass a ring of relay machines (read a value, output it plus one) on four workers. They are seeded
+		by the idle handler once every machine parked, and the second idle call ends the run.
+	*/
+	inline void scheduler_ring_delivers_every_token()
+	{
+		constexpr size_t machine_count = 16;
+		constexpr size_t token_count = 4;
+		constexpr int64_t hops = 100;
+
+		std::vector<int64_t> relay = { 3, 100, 1001, 100, 1, 100, 4, 100, 1105, 1, 0 };
+		relay.resize(101, 0);
+
+		IntcodeScheduler scheduler(4);
+
+		for (size_t i = 0; i < machine_count; i++)
+			scheduler.add(IntcodeVM(relay));
+
+		std::mutex arrived_mutex;
+		std::vector<int64_t> arrived;
+		size_t idle_calls = 0;
+
+		scheduler.run([&](IntcodeScheduler::machine_id_t id, IntcodeChannel& output)
+		{
+			while (!output.empty())
+			{
+				auto value = output.pop();
+
+				if (value < hops)
+				{
+					scheduler.deliver((id + 1) % machine_count, { value });
+					continue;
+				}
+
+				std::lock_guard<std::mutex> lock(arrived_mutex);
+				arrived.push_back(value);
+			}
+		},
+		[&]
+		{
+			if (idle_calls++)
+				return false;
+
+			for (size_t token = 0; token < token_count; token++)
+				scheduler.deliver(token * machine_count / token_count, { 0 });
+
+			return true;
+		});
+
+		expect(arrived == std::vector<int64_t>(token_count, hops), std::to_string(arrived.size()) + " of " + std::to_string(token_count) + " tokens arrived");
+		expect(idle_calls == 2, "the idle handler ran " + std::to_string(idle_calls) + " times");
+	}
+
+	// a machine reading -1 loops back to its input, it gets poll_value once and then parks until a delivery
+	inline void scheduler_polls_once_then_parks()
+	{
+		IntcodeScheduler scheduler(1);
+		scheduler.poll_value = -1;
+
+		auto id = scheduler.add(IntcodeVM(std::vector<int64_t>{ 3, 100, 1008, 100, -1, 101, 1005, 101, 0, 1001, 100, 1, 100, 4, 100, 99 }));
+
+		std::vector<int64_t> outputs;
+		size_t idle_calls = 0;
+
+		scheduler.run([&](IntcodeScheduler::machine_id_t, IntcodeChannel& output)
+		{
+			while (!output.empty())
+				outputs.push_back(output.pop());
+		},
+		[&]
+		{
+			if (idle_calls++)
+				return false;
+
+			scheduler.deliver(id, { 41 });
+			return true;
+		});
+
+		expect(outputs == std::vector<int64_t>{ 42 }, "the machine did not answer 42");
+		expect(idle_calls == 2, "the idle handler ran " + std::to_string(idle_calls) + " times");
+
+		// asking, the polled -1, the delivered 41
+		expect(scheduler.slices() == 3, "took " + std::to_string(scheduler.slices()) + " slices");
+	}
+
+	inline int run_all(std::ostream& out)
+	{
+		std::vector<std::pair<const char*, void(*)()>> all = {
+			{ "pooled VM sees host patches", pooled_vm_sees_host_patches },
+			{ "pipeline drops output for a halted stage", pipeline_drops_output_for_halted_stage },
+			{ "checkpoint rejects an edited header", checkpoint_rejects_edited_header },
+			{ "coroutine awaits input and yields output", coroutine_awaits_input_and_yields_output },
+			{ "scheduler ring delivers every token", scheduler_ring_delivers_every_token },
+			{ "scheduler polls once then parks", scheduler_polls_once_then_parks },
+		};
+
+		size_t failed = 0;
+
+		for (auto& [name, test] : all)
+		{
+			try
+			{
+				test();
+				out << "ok    " << name << std::endl;
+			}
+			catch (const std::exception& e)
+			{
+				failed++;
+				out << "FAIL  " << name << ": " << e.what() << std::endl;
+			}
+		}
+
+		out << all.size() - failed << " of " << all.size() << " tests passed" << std::endl;
+
+		return failed ? 1 : 0;
+	}
+}
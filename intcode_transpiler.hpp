@@ -0,0 +1,218 @@
+#pragma once
+
+#include <fstream>
+#include <iomanip>
+#include <set>
+#include <sstream>
+
+#include "intcode.hpp"
+#include "intcode_cfg.hpp"
+
+/**
+	Ahead-of-time translation of an Intcode program into a C++ translation unit.
+
+	Every statically reachable instruction becomes a case of a switch over the instruction pointer,
+	with its opcode and parameter modes baked in. Argument words are still read from memory,
+	so programs which patch their own arguments stay correct. Before an instruction runs its opcode word
+	is compared with the one seen at translation time, on a mismatch (self-modified code) or when control
+	flow reaches an address which was not translated the VM interprets a single instruction and tries again.
+
+	The generated unit registers itself under the hash of the program image,
+	VMs created from the same image pick it up when running with engine_t::compiled.
+*/
+namespace transpiler {
+
+	inline bool is_jump(opcode_t opcode)
+	{
+		return opcode == opcode_t::jump_if_true || opcode == opcode_t::jump_if_false;
+	}
+
+	/**
+		Instructions found by the control flow analysis, including the return sites of calls.
+	*/
+	inline std::set<int64_t> reachable_instructions(const std::vector<int64_t>& program)
+	{
+		return ControlFlowGraph(program).instructions;
+	}
+
+	inline std::string argument(int64_t address)
+	{
+		return "memory.read(" + std::to_string(address) + ")";
+	}
+
+	inline std::string source(const InstructionParameter& parameter, int64_t address)
+	{
+		switch (parameter.m_mode)
+		{
+		case mode_t::positional:
+			return "memory.read(" + argument(address) + ")";
+
+		case mode_t::relative:
+			return "memory.read(" + argument(address) + " + rb)";
+
+		default:
+			return argument(address);
+		}
+	}
+
+	inline std::string destination(const InstructionParameter& parameter, int64_t address)
+	{
+		if (parameter.m_mode == mode_t::relative)
+			return argument(address) + " + rb";
+
+		return argument(address);
+	}
+
+	inline bool translatable(const DecodedInstruction& decoded)
+	{
+		auto size = IntcodeVM::instruction_size(static_cast<int64_t>(decoded.opcode));
+
+		switch (decoded.opcode)
+		{
+		case opcode_t::add:
+		case opcode_t::multiply:
+		case opcode_t::less_than:
+		case opcode_t::equals:
+		case opcode_t::input:
+			// writing to an immediate parameter throws, leave that to the interpreter
+			return decoded.parameters[size - 2].m_mode != mode_t::immediate;
+
+		default:
+			return true;
+		}
+	}
+
+	inline std::string transpile(const std::vector<int64_t>& program, const std::string& origin = "")
+	{
+		auto reachable = reachable_instructions(program);
+		auto hash = program_hash(program);
+
+		std::ostringstream code;
+
+		code << "// generated from " << (origin.empty() ? "an Intcode program" : origin) << ", do not edit\n";
+		code << "#include \"intcode.hpp\"\n\n";
+		code << "namespace {\n\n";
+		code << "execution_state_t compiled_program(IntcodeVM& vm, int64_t& output, int64_t input, bool request_input)\n";
+		code << "{\n";
+		code << "\tauto& memory = vm.memory;\n";
+		code << "\tauto ip = vm.instruction_pointer;\n";
+		code << "\tauto rb = vm.relative_base;\n";
+		code << "\texecution_state_t state = execution_state_t::normal;\n\n";
+		code << "\twhile (true)\n";
+		code << "\t{\n";
+		code << "\t\tswitch (ip)\n";
+		code << "\t\t{\n";
+
+		for (auto address : reachable)
+		{
+			auto word = program[address];
+			auto decoded = IntcodeVM::decode_word(word);
+
+			if (!translatable(decoded))
+				continue;
+
+			auto& parameters = decoded.parameters;
+			auto next = address + IntcodeVM::instruction_size(word % 100);
+
+			auto src = [&](size_t n) { return source(parameters[n], address + 1 + static_cast<int64_t>(n)); };
+			auto dest = [&](size_t n) { return destination(parameters[n], address + 1 + static_cast<int64_t>(n)); };
+
+			code << "\t\tcase " << address << ":\n";
+			code << "\t\t\tif (memory.read(" << address << ") != " << word << ") break;\n";
+
+			switch (decoded.opcode)
+			{
+			case opcode_t::add:
+				code << "\t\t\tvm.store(" << dest(2) << ", " << src(0) << " + " << src(1) << ");\n";
+				break;
+
+			case opcode_t::multiply:
+				code << "\t\t\tvm.store(" << dest(2) << ", " << src(0) << " * " << src(1) << ");\n";
+				break;
+
+			case opcode_t::less_than:
+				code << "\t\t\tvm.store(" << dest(2) << ", (" << src(0) << " < " << src(1) << ") ? 1 : 0);\n";
+				break;
+
+			case opcode_t::equals:
+				code << "\t\t\tvm.store(" << dest(2) << ", (" << src(0) << " == " << src(1) << ") ? 1 : 0);\n";
+				break;
+
+			case opcode_t::adjust_base:
+				code << "\t\t\trb += " << src(0) << ";\n";
+				break;
+
+			case opcode_t::jump_if_true:
+				code << "\t\t\tip = (" << src(0) << " > 0) ? " << src(1) << " : " << next << ";\n";
+				code << "\t\t\tcontinue;\n";
+				continue;
+
+			case opcode_t::jump_if_false:
+				code << "\t\t\tip = (" << src(0) << " == 0) ? " << src(1) << " : " << next << ";\n";
+				code << "\t\t\tcontinue;\n";
+				continue;
+
+			case opcode_t::input:
+				code << "\t\t\tif (request_input) { state = execution_state_t::requested_value; goto done; }\n";
+				code << "\t\t\tvm.store(" << dest(0) << ", input);\n";
+				code << "\t\t\tip = " << next << ";\n";
+				code << "\t\t\tstate = execution_state_t::consumed_value;\n";
+				code << "\t\t\tgoto done;\n";
+				continue;
+
+			case opcode_t::output:
+				code << "\t\t\toutput = " << src(0) << ";\n";
+				code << "\t\t\tip = " << next << ";\n";
+				code << "\t\t\tstate = execution_state_t::provided_value;\n";
+				code << "\t\t\tgoto done;\n";
+				continue;
+
+			case opcode_t::halt:
+				code << "\t\t\tip = " << next << ";\n";
+				code << "\t\t\tstate = execution_state_t::halted;\n";
+				code << "\t\t\tgoto done;\n";
+				continue;
+			}
+
+			code << "\t\t\tip = " << next << ";\n";
+
+			auto following = reachable.upper_bound(address);
+			if (following != reachable.end() && *following == next && translatable(IntcodeVM::decode_word(program[next])))
+				code << "\t\t\t[[fallthrough]];\n";
+			else
+				code << "\t\t\tcontinue;\n";
+		}
+
+		code << "\t\tdefault:\n";
+		code << "\t\t\tbreak;\n";
+		code << "\t\t}\n\n";
+		code << "\t\t// not translated or modified since, interpret a single instruction\n";
+		code << "\t\tvm.instruction_pointer = ip;\n";
+		code << "\t\tvm.relative_base = rb;\n\n";
+		code << "\t\tstate = vm.dispatch(output, input, request_input, true);\n\n";
+		code << "\t\tip = vm.instruction_pointer;\n";
+		code << "\t\trb = vm.relative_base;\n\n";
+		code << "\t\tif (state != execution_state_t::normal)\n";
+		code << "\t\t\tbreak;\n";
+		code << "\t}\n\n";
+		code << "done:\n";
+		code << "\tvm.instruction_pointer = ip;\n";
+		code << "\tvm.relative_base = rb;\n\n";
+		code << "\treturn state;\n";
+		code << "}\n\n";
+		code << "const CompiledProgramRegistration registration(0x" << std::hex << std::setw(16) << std::setfill('0') << hash << "ull, compiled_program);\n\n";
+		code << "}\n";
+
+		return code.str();
+	}
+
+	inline void transpile_file(const std::string& input_filepath, const std::string& output_filepath)
+	{
+		std::ofstream output(output_filepath);
+
+		if (!output)
+			throw std::runtime_error("could not open " + output_filepath);
+
+		output << transpile(load_program(input_filepath), input_filepath);
+	}
+}
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "intcode.hpp"
+#include "intcode_cfg.hpp"
+
+/**
+	Load-time verification of a program image. Every instruction the control flow graph reaches is checked once:
+	a known opcode, parameter modes the VM implements, no immediate destination and its arguments inside the image.
+	Words execution would fall or jump into are checked the same way, the graph stops exploring at them.
+
+	Instructions which pass and which no store with a known address rewrites are registered as verified code
+	of the image, the engines then resolve their destinations without mode checks. Issues are reported, not fatal:
+	a program only fails if it executes a bad instruction, on the checked path and with the usual error.
+*/
+struct VerificationReport
+{
+	struct Issue
+	{
+		int64_t address;
+		int64_t word;
+		std::string reason;
+	};
+
+	size_t reachable = 0;
+	size_t verified = 0;
+	size_t self_modified = 0;
+	std::vector<Issue> issues;
+
+	// runs of verified instructions
+	std::vector<ControlFlowGraph::Region> regions;
+
+	void print(std::ostream& out) const
+	{
+		out << verified << " of " << reachable << " reachable instructions verified in " << regions.size() << " regions, "
+			<< self_modified << " possibly self-modified" << std::endl;
+
+		for (auto& region : regions)
+			out << "[" << region.begin << ", " << region.end << ")" << std::endl;
+
+		for (auto& issue : issues)
+			out << issue.address << ": " << issue.word << " " << issue.reason << std::endl;
+	}
+};
+
+namespace verifier {
+
+	// index of the parameter an opcode stores to, -1 for opcodes which do not store
+	inline int64_t destination(opcode_t opcode)
+	{
+		switch (opcode)
+		{
+		case opcode_t::add:
+		case opcode_t::multiply:
+		case opcode_t::less_than:
+		case opcode_t::equals:
+			return 2;
+
+		case opcode_t::input:
+			return 0;
+
+		default:
+			return -1;
+		}
+	}
+
+	// nullptr when the instruction at address is well formed
+	inline const char* check(const std::vector<int64_t>& program, int64_t address)
+	{
+		if (address < 0 || static_cast<size_t>(address) >= program.size())
+			return "outside of the image";
+
+		auto word = program[static_cast<size_t>(address)];
+		auto size = IntcodeVM::instruction_size(word % 100);
+
+		if (!size)
+			return "illegal opcode";
+
+		if (address + size > static_cast<int64_t>(program.size()))
+			return "arguments past the end of the image";
+
+		auto modes = word / 100;
+		for (int64_t i = 0; i < size - 1; i++, modes /= 10)
+		{
+			if (modes % 10 > static_cast<int64_t>(mode_t::relative))
+				return "invalid parameter mode";
+
+			if (i == destination(static_cast<opcode_t>(word % 100)) && modes % 10 == static_cast<int64_t>(mode_t::immediate))
+				return "immediate destination";
+		}
+
+		return nullptr;
+	}
+}
+
+/**
+	Verifies the program and registers its verified code under its image hash, for every VM created
+	from the program afterwards. Verifying the same program again replaces the registration.
+	The report, when asked for, also explains what was not verified.
+*/
+inline std::shared_ptr<const VerifiedCode> verify_program(const std::vector<int64_t>& program, VerificationReport* report = nullptr)
+{
+	ControlFlowGraph cfg(program);
+
+	auto code = std::make_shared<VerifiedCode>();
+	code->words = program;
+	code->instructions.assign(program.size(), false);
+
+	auto reject = [&](int64_t address, const char* reason)
+	{
+		auto word = address >= 0 && static_cast<size_t>(address) < program.size() ? program[static_cast<size_t>(address)] : 0;
+		report->issues.push_back({ address, word, reason });
+	};
+
+	for (auto address : cfg.instructions)
+	{
+		auto reason = verifier::check(program, address);
+		bool stable = cfg.is_stable(address);
+
+		if (!reason && stable)
+			code->instructions[static_cast<size_t>(address)] = true;
+
+		if (!report)
+			continue;
+
+		report->reachable++;
+
+		if (reason)
+		{
+			reject(address, reason);
+			continue;
+		}
+
+		if (!stable)
+		{
+			report->self_modified++;
+			continue;
+		}
+
+		report->verified++;
+
+		auto end = address + IntcodeVM::instruction_size(program[static_cast<size_t>(address)] % 100);
+
+		if (!report->regions.empty() && report->regions.back().end == address)
+			report->regions.back().end = end;
+		else
+			report->regions.push_back({ address, end, true });
+	}
+
+	register_verified_code(program_hash(program), code);
+
+	if (!report)
+		return code;
+
+	// successors the graph did not decode, execution reaching them fails
+	for (auto target : cfg.jump_targets)
+	{
+		if (cfg.is_instruction(target))
+			continue;
+
+		if (auto reason = verifier::check(program, target))
+			reject(target, reason);
+	}
+
+	for (auto address : cfg.instructions)
+	{
+		auto word = program[static_cast<size_t>(address)];
+		auto opcode = static_cast<opcode_t>(word % 100);
+		auto next = address + IntcodeVM::instruction_size(word % 100);
+
+		if (opcode == opcode_t::halt || cfg.is_instruction(next))
+			continue;
+
+		// a constant jump either always or never falls through
+		if (cfg.constant_jumps.count(address))
+		{
+			auto condition = program[static_cast<size_t>(address + 1)];
+			if (opcode == opcode_t::jump_if_true ? condition > 0 : condition == 0)
+				continue;
+		}
+
+		if (auto reason = verifier::check(program, next))
+			reject(next, reason);
+	}
+
+	return code;
+}
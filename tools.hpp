@@ -0,0 +1,164 @@
+#pragma once
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "benchmarks.hpp"
+#include "intcode.hpp"
+#include "intcode_cfg.hpp"
+#include "intcode_checkpoint.hpp"
+#include "intcode_image.hpp"
+#include "intcode_tests.hpp"
+#include "intcode_transpiler.hpp"
+#include "intcode_verifier.hpp"
+
+/**
+	Command line tools living in the solver binary, kept apart from solving puzzles:
+
+		--transpile <program> <output>          writes the ahead-of-time compiled version of a program
+		--cfg <program>                         prints the basic blocks of a program and statistics about them
+		--image <program> <image> [varint]      converts a program to the binary image format
+		--session <checkpoint> <program> [line] plays an ASCII program one line at a time across runs
+		--verify <program>                      prints which instructions the load-time verifier accepted
+		--profile <program> [inputs...]         reports where a run spends its time and which memory is hot
+		--scheduler-benchmark [machines]        passes tokens around a ring of relay machines on the scheduler
+		--self-test                             runs the regression tests of the Intcode machinery
+*/
+namespace tools {
+
+	/**
+		Resumes from the checkpoint file (or starts the program when there is none), types the line,
+		prints what the program answers and appends the new state to the checkpoint.
+	*/
+	inline int session(const std::string& checkpoint_filepath, const std::string& program_filepath, const std::string& typed)
+	{
+		bool resuming = std::ifstream(checkpoint_filepath).good();
+
+		uint64_t intact_size = 0;
+		IntcodeVM vm = resuming ? restore_checkpoint(checkpoint_filepath, &intact_size) : IntcodeVM(program_filepath);
+		auto writer = resuming ? IntcodeCheckpointWriter(checkpoint_filepath, vm, intact_size) : IntcodeCheckpointWriter(checkpoint_filepath);
+
+		std::string line = typed.empty() ? std::string() : typed + '\n';
+		auto next_input = line.begin();
+		execution_state_t state{};
+
+		do
+		{
+			next_input = vm.input_channel.write(next_input, line.end());
+			state = vm.run();
+
+			while (!vm.output_channel.empty())
+				std::cout << static_cast<char>(vm.output_channel.pop());
+		} while (state == execution_state_t::provided_value || (state == execution_state_t::requested_value && next_input != line.end()));
+
+		auto pages = writer.write(vm);
+		std::cout << std::endl << (state == execution_state_t::halted ? "halted" : "waiting for input") << ", checkpoint wrote " << pages << " pages" << std::endl;
+
+		return 0;
+	}
+
+	// the block profile goes to <program>.profile.csv, the sampled access trace to <program>.trace
+	inline int profile(const std::string& program_filepath, const std::vector<int64_t>& inputs)
+	{
+		IntcodeVM vm(program_filepath);
+		IntcodeProfiler profiler;
+		profiler.time_blocks = true;
+		vm.profiler = &profiler;
+
+		IntcodeWatcher watcher;
+		watcher.trace_interval = 16;
+		vm.watcher = &watcher;
+
+		auto next_input = inputs.begin();
+		size_t outputs = 0;
+		execution_state_t state{};
+
+		do
+		{
+			next_input = vm.input_channel.write(next_input, inputs.end());
+			state = vm.run();
+
+			outputs += vm.output_channel.size();
+			vm.output_channel.clear();
+		} while (state == execution_state_t::provided_value || (state == execution_state_t::requested_value && next_input != inputs.end()));
+
+		std::cout << (state == execution_state_t::halted ? "halted" : "stopped waiting for input") << " after " << outputs << " outputs" << std::endl << std::endl;
+		profiler.report(std::cout);
+
+		std::ofstream dump(program_filepath + ".profile.csv");
+		profiler.dump(dump);
+
+		std::cout << std::endl << "hot memory (every " << watcher.trace_interval << "th access sampled):" << std::endl;
+		for (auto [address, samples] : watcher.hot_addresses())
+			std::cout << std::setw(16) << address << std::setw(14) << samples << std::endl;
+
+		watcher.write_trace(program_filepath + ".trace");
+
+		return 0;
+	}
+}
+
+/**
+	Runs the tool named by the arguments and returns its exit code, nothing when they name none.
+*/
+inline std::optional<int> run_tool(int argc, char* argv[])
+{
+	if (argc < 2)
+		return std::nullopt;
+
+	std::string tool = argv[1];
+
+	if (tool == "--transpile" && argc == 4)
+	{
+		transpiler::transpile_file(argv[2], argv[3]);
+		return 0;
+	}
+
+	if (tool == "--cfg" && argc == 3)
+	{
+		ControlFlowGraph(load_program(argv[2])).print(std::cout);
+		return 0;
+	}
+
+	if (tool == "--image" && (argc == 4 || argc == 5))
+	{
+		program_image::write(argv[3], load_program(argv[2]), argc == 5 && std::string(argv[4]) == "varint");
+		return 0;
+	}
+
+	if (tool == "--session" && (argc == 4 || argc == 5))
+		return tools::session(argv[2], argv[3], argc == 5 ? argv[4] : "");
+
+	if (tool == "--verify" && argc == 3)
+	{
+		VerificationReport report;
+		verify_program(load_program(argv[2]), &report);
+		report.print(std::cout);
+		return 0;
+	}
+
+	if (tool == "--profile" && argc >= 3)
+	{
+		std::vector<int64_t> inputs;
+
+		for (int i = 3; i < argc; i++)
+			inputs.push_back(std::stoll(argv[i]));
+
+		return tools::profile(argv[2], inputs);
+	}
+
+	if (tool == "--scheduler-benchmark" && (argc == 2 || argc == 3))
+	{
+		benchmark_scheduler(argc == 3 ? std::stoull(argv[2]) : 10000, 100, 10000);
+		return 0;
+	}
+
+	if (tool == "--self-test" && argc == 2)
+		return tests::run_all(std::cout);
+
+	return std::nullopt;
+}